@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hash.h"
+#include "cache.h"
+
+uint64_t cache_key(uint64_t payload, const uint64_t *params, size_t nparams) {
+    return hash_block(payload, (const uint8_t *)params, nparams * sizeof(uint64_t));
+}
+
+/**
+ * This function copies the content of one open file into another one, with
+ * copy_file_range and with read/write if the kernel can't copy between the
+ * two file systems.
+ * @param in Source file
+ * @param out Destination file, empty
+ * @return 0 on success, -1 otherwise
+ */
+static int copy_fd(int in, int out) {
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        return -1;
+    }
+    size_t left = (size_t)st.st_size;
+    while (left > 0) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, left, 0);
+        if (n > 0) {
+            left -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+            break;
+        }
+        return -1;
+    }
+
+    // Fallback, continues at the current offsets
+    char buf[65536];
+    while (left > 0) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n <= 0 || write(out, buf, (size_t)n) != n) {
+            return -1;
+        }
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+int cache_fetch(const char *dir, uint64_t key, const char *ext, const char *path) {
+    char entry[PATH_MAX];
+    if (snprintf(entry, sizeof(entry), "%s/%016lx%s", dir, key, ext) >= (int)sizeof(entry)) {
+        return 0;
+    }
+    int in = open(entry, O_RDONLY);
+    if (in < 0) {
+        return 0;
+    }
+    int out = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRWXU);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    int ret = copy_fd(in, out);
+    close(in);
+    if (close(out) != 0 || ret != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+int cache_store(const char *dir, uint64_t key, const char *ext, const char *path) {
+    char entry[PATH_MAX];
+    char tmp[PATH_MAX];
+    if (snprintf(entry, sizeof(entry), "%s/%016lx%s", dir, key, ext) >= (int)sizeof(entry) ||
+        snprintf(tmp, sizeof(tmp), "%s/.%016lx.%d", dir, key, (int)getpid()) >= (int)sizeof(tmp)) {
+        return -1;
+    }
+    if (mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    int in = open(path, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    int ret = copy_fd(in, out);
+    close(in);
+    if (close(out) != 0 || ret != 0 || rename(tmp, entry) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
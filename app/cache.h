@@ -0,0 +1,38 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * This function derives the key of a result from the hash of the input
+ * samples and the parameters the output depends on (dimensions, scaling
+ * factor, coefficients, precision and filter of the kernel, output format,
+ * ...).
+ * @param payload Hash of the input samples
+ * @param params Parameters
+ * @param nparams Number of parameters
+ * @return Key of the result
+ */
+uint64_t cache_key(uint64_t payload, const uint64_t *params, size_t nparams);
+
+/**
+ * This function serves a result from the cache: if <dir>/<key><ext> exists,
+ * it is copied to path with copy_file_range (the kernel copies inside the
+ * page cache, or shares the blocks on file systems with reflinks).
+ * @param dir Cache directory
+ * @param key Key of the result
+ * @param ext Extension of the result (".pgm" or ".ppm")
+ * @param path Output file
+ * @return 1 on a hit, 0 on a miss, -1 if the output could not be written
+ */
+int cache_fetch(const char *dir, uint64_t key, const char *ext, const char *path);
+
+/**
+ * This function stores a result in the cache as <dir>/<key><ext>. The
+ * directory is created if needed, and the file is copied under a temporary
+ * name and renamed, so concurrent runs never see a partial result.
+ * @param dir Cache directory
+ * @param key Key of the result
+ * @param ext Extension of the result
+ * @param path Output file that was just written
+ * @return 0 on success, -1 otherwise
+ */
+int cache_store(const char *dir, uint64_t key, const char *ext, const char *path);
@@ -0,0 +1,294 @@
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "filter.h"
+#include "interpolate.h"
+
+// Fraction bits of the horizontally filtered rows
+#define FILTER_HBITS 6
+#define FILTER_ONE (1 << FILTER_BITS)
+#define FILTER_PI 3.14159265358979323846
+
+#ifdef INTERPOLATE_VERIFY
+bool filter_scalar = false;
+#else
+#define filter_scalar false
+#endif
+
+size_t filter_taps(int filter){
+    switch (filter){
+        case FILTER_BICUBIC:
+            return 4;
+        case FILTER_LANCZOS:
+            return 6;
+        default:
+            return 2;
+    }
+}
+
+/**
+ * This function returns the weight of a source pixel at distance t from the
+ * output pixel.
+ * @param filter FILTER_BICUBIC or FILTER_LANCZOS
+ * @param t Distance in source pixels
+ */
+static double filter_kernel(int filter, double t){
+    t = fabs(t);
+    if (filter == FILTER_BICUBIC){
+        //Catmull-Rom, the cubic convolution kernel with a = -0.5
+        if (t < 1){
+            return (1.5 * t - 2.5) * t * t + 1;
+        }
+        if (t < 2){
+            return ((-0.5 * t + 2.5) * t - 4) * t + 2;
+        }
+        return 0;
+    }
+    if (t == 0){
+        return 1;
+    }
+    if (t >= 3){
+        return 0;
+    }
+    return 3 * sin(FILTER_PI * t) * sin(FILTER_PI * t / 3) / (FILTER_PI * FILTER_PI * t * t);
+}
+
+void filter_weights(int filter, size_t d, size_t s, int16_t *weights){
+    size_t taps = filter_taps(filter);
+    double f = (double)d / (double)s;
+    double kernel[FILTER_TAPS_MAX];
+    double norm = 0;
+    for (size_t k = 0; k < taps; k++){
+        kernel[k] = filter_kernel(filter, (double)k - (double)(taps / 2 - 1) - f);
+        norm += kernel[k];
+    }
+    //The Lanczos weights do not add up to one by themselves, so they are normalized before rounding
+    long sum = 0;
+    for (size_t k = 0; k < taps; k++){
+        weights[k] = (int16_t)lround(kernel[k] / norm * FILTER_ONE);
+        sum += weights[k];
+    }
+    //The rounding error goes to the nearest source pixel, so the weights add up to exactly one
+    weights[taps / 2 - 1 + (2 * d >= s)] += (int16_t)(FILTER_ONE - sum);
+}
+
+void filter_source_rows(size_t height, size_t scale_factor, int filter, size_t y, size_t h, size_t *first_row,
+                        size_t *row_count){
+    if (filter == FILTER_BILINEAR){
+        interpolate_source_rows(height, scale_factor, y, h, first_row, row_count);
+        return;
+    }
+    size_t r = filter_taps(filter) / 2;
+    size_t first = y / scale_factor;
+    size_t last = (y + h - 1) / scale_factor + r;
+    first = (first >= r - 1) ? first - (r - 1) : 0;
+    if (last > height - 1){
+        last = height - 1;
+    }
+    *first_row = first;
+    *row_count = last - first + 1;
+}
+
+/**
+ * This function widens n source pixels starting at column c0 to 16 bit, the
+ * columns outside the image repeat the edge pixels.
+ * @param row Source row
+ * @param width Width of the source image
+ * @param c0 First column, may be negative
+ * @param n Number of columns
+ * @param src Widened pixels
+ */
+static void filter_fill(const uint8_t *row, size_t width, long c0, size_t n, int16_t *src){
+    for (size_t k = 0; k < n; k++){
+        long c = c0 + (long)k;
+        c = (c < 0) ? 0 : c;
+        c = (c > (long)width - 1) ? (long)width - 1 : c;
+        src[k] = row[c];
+    }
+}
+
+/**
+ * This function filters a source row horizontally. The taps of an output
+ * pixel are loaded as pairs of 16 bit pixels with one gather per pair, and
+ * pmaddwd multiplies them with the pair of weights of the pixel and adds
+ * them.
+ * @param src Widened source pixels
+ * @param jtab First tap of every output pixel in src
+ * @param wtab Weights of every output pixel, one table per pair of taps (tap 2p in the low half)
+ * @param pairs Number of pairs of taps
+ * @param n Number of output pixels
+ * @param out Filtered pixels with FILTER_HBITS fraction bits
+ */
+__attribute__((target("avx2")))
+static void filter_horizontal_avx2(const int16_t *src, const uint32_t *jtab, int32_t (*wtab)[FILTER_CHUNK],
+                                   size_t pairs, size_t n, int16_t *out){
+    __m256i bias = _mm256_set1_epi32(1 << (FILTER_BITS - FILTER_HBITS - 1));
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8){
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(jtab + k));
+        __m256i acc = bias;
+        for (size_t p = 0; p < pairs; p++){
+            __m256i pix = _mm256_i32gather_epi32((const int *)src, _mm256_add_epi32(idx, _mm256_set1_epi32(2 * p)), 2);
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pix, _mm256_loadu_si256((const __m256i *)(wtab[p] + k))));
+        }
+        acc = _mm256_srai_epi32(acc, FILTER_BITS - FILTER_HBITS);
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(acc, acc), 0x08);
+        _mm_storeu_si128((__m128i *)(out + k), _mm256_castsi256_si128(words));
+    }
+    for (; k < n; k++){
+        int32_t acc = 1 << (FILTER_BITS - FILTER_HBITS - 1);
+        for (size_t p = 0; p < pairs; p++){
+            const int16_t *q = src + jtab[k] + 2 * p;
+            acc += q[0] * (int16_t)(wtab[p][k] & 0xffff) + q[1] * (int16_t)(wtab[p][k] >> 16);
+        }
+        out[k] = (int16_t)(acc >> (FILTER_BITS - FILTER_HBITS));
+    }
+}
+
+/**
+ * Scalar version of filter_horizontal_avx2 for CPUs without AVX2.
+ */
+static void filter_horizontal_scalar(const int16_t *src, const uint32_t *jtab, int32_t (*wtab)[FILTER_CHUNK],
+                                     size_t pairs, size_t n, int16_t *out){
+    for (size_t k = 0; k < n; k++){
+        int32_t acc = 1 << (FILTER_BITS - FILTER_HBITS - 1);
+        for (size_t p = 0; p < pairs; p++){
+            const int16_t *q = src + jtab[k] + 2 * p;
+            acc += q[0] * (int16_t)(wtab[p][k] & 0xffff) + q[1] * (int16_t)(wtab[p][k] >> 16);
+        }
+        out[k] = (int16_t)(acc >> (FILTER_BITS - FILTER_HBITS));
+    }
+}
+
+/**
+ * This function blends the horizontally filtered rows into an output row.
+ * Two rows are interleaved word by word, so one pmaddwd multiplies a pixel
+ * of both rows with their weights and adds them. The result is rounded,
+ * clamped to 0 .. 255 and packed to bytes.
+ * @param rows Filtered rows, one per tap
+ * @param weights Weights of the rows
+ * @param taps Number of taps (even)
+ * @param n Number of output pixels
+ * @param out Output pixels
+ */
+__attribute__((target("avx2")))
+static void filter_vertical_avx2(const int16_t *const *rows, const int16_t *weights, size_t taps, size_t n,
+                                 uint8_t *out){
+    __m256i bias = _mm256_set1_epi32(1 << (FILTER_BITS + FILTER_HBITS - 1));
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16){
+        __m256i lo = bias;
+        __m256i hi = bias;
+        for (size_t t = 0; t < taps; t += 2){
+            __m256i a = _mm256_loadu_si256((const __m256i *)(rows[t] + k));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(rows[t + 1] + k));
+            __m256i pair = _mm256_set1_epi32((int32_t)(((uint32_t)(uint16_t)weights[t + 1] << 16) |
+                                                       (uint16_t)weights[t]));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pair));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pair));
+        }
+        lo = _mm256_srai_epi32(lo, FILTER_BITS + FILTER_HBITS);
+        hi = _mm256_srai_epi32(hi, FILTER_BITS + FILTER_HBITS);
+        //The unpacks work within 128 bit lanes, packssdw restores the order of the pixels per lane
+        __m256i words = _mm256_packs_epi32(lo, hi);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128((__m128i *)(out + k), _mm256_castsi256_si128(bytes));
+    }
+    for (; k < n; k++){
+        int32_t acc = 1 << (FILTER_BITS + FILTER_HBITS - 1);
+        for (size_t t = 0; t < taps; t++){
+            acc += rows[t][k] * weights[t];
+        }
+        acc >>= FILTER_BITS + FILTER_HBITS;
+        out[k] = (uint8_t)((acc < 0) ? 0 : (acc > 255) ? 255 : acc);
+    }
+}
+
+/**
+ * Scalar version of filter_vertical_avx2 for CPUs without AVX2.
+ */
+static void filter_vertical_scalar(const int16_t *const *rows, const int16_t *weights, size_t taps, size_t n,
+                                   uint8_t *out){
+    for (size_t k = 0; k < n; k++){
+        int32_t acc = 1 << (FILTER_BITS + FILTER_HBITS - 1);
+        for (size_t t = 0; t < taps; t++){
+            acc += rows[t][k] * weights[t];
+        }
+        acc >>= FILTER_BITS + FILTER_HBITS;
+        out[k] = (uint8_t)((acc < 0) ? 0 : (acc > 255) ? 255 : acc);
+    }
+}
+
+void interpolate_region_filter(const uint8_t *gray, size_t first_row, size_t width, size_t height,
+                               size_t scale_factor, int filter, size_t x, size_t y, size_t w, size_t h,
+                               size_t stride, uint8_t *result){
+    size_t s = scale_factor;
+    size_t taps = filter_taps(filter);
+    size_t r = taps / 2;
+    bool avx2 = !filter_scalar && __builtin_cpu_supports("avx2");
+    uint32_t jtab[FILTER_CHUNK];
+    int32_t wtab[FILTER_TAPS_MAX / 2][FILTER_CHUNK];
+    int16_t src[FILTER_CHUNK + FILTER_TAPS_MAX];
+    int16_t rows[FILTER_TAPS_MAX][FILTER_CHUNK];
+    const int16_t *ring[FILTER_TAPS_MAX];
+    long tags[FILTER_TAPS_MAX];
+    int16_t weights[FILTER_TAPS_MAX];
+
+    //The column tables and the filtered rows of a chunk are shared by all rows
+    for (size_t cx = 0; cx < w; cx += FILTER_CHUNK){
+        size_t cw = (w - cx < FILTER_CHUNK) ? w - cx : FILTER_CHUNK;
+        size_t j0 = (x + cx) / s;
+        size_t ncols = (x + cx + cw - 1) / s - j0 + taps;
+        for (size_t col = 0; col < cw; col++){
+            jtab[col] = (uint32_t)((x + cx + col) / s - j0);
+            //The weights repeat every s columns
+            if (col >= s){
+                for (size_t p = 0; p < r; p++){
+                    wtab[p][col] = wtab[p][col - s];
+                }
+                continue;
+            }
+            filter_weights(filter, (x + cx + col) % s, s, weights);
+            for (size_t p = 0; p < r; p++){
+                wtab[p][col] = (int32_t)(((uint32_t)(uint16_t)weights[2 * p + 1] << 16) | (uint16_t)weights[2 * p]);
+            }
+        }
+        for (size_t t = 0; t < taps; t++){
+            tags[t] = LONG_MIN;
+        }
+
+        for (size_t row = 0; row < h; row++){
+            size_t i = (y + row) / s;
+            filter_weights(filter, (y + row) % s, s, weights);
+
+            //Source rows i - r + 1 .. i + r, each one is filtered once and kept while it is in reach
+            for (size_t t = 0; t < taps; t++){
+                long k = (long)i - (long)r + 1 + (long)t;
+                size_t slot = (size_t)((k + (long)taps) % (long)taps);
+                if (tags[slot] != k){
+                    tags[slot] = k;
+                    size_t kk = (k < 0) ? 0 : ((size_t)k > height - 1) ? height - 1 : (size_t)k;
+                    filter_fill(gray + (kk - first_row) * width, width, (long)j0 - (long)r + 1, ncols, src);
+                    if (avx2){
+                        filter_horizontal_avx2(src, jtab, wtab, r, cw, rows[slot]);
+                    }
+                    else {
+                        filter_horizontal_scalar(src, jtab, wtab, r, cw, rows[slot]);
+                    }
+                }
+                ring[t] = rows[slot];
+            }
+
+            uint8_t *out = result + row * stride + cx;
+            if (avx2){
+                filter_vertical_avx2(ring, weights, taps, cw, out);
+            }
+            else {
+                filter_vertical_scalar(ring, weights, taps, cw, out);
+            }
+        }
+    }
+}
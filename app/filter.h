@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Resampling filters (--filter)
+#define FILTER_BILINEAR 0  // matrix_formula, the kernels of interpolate.c
+#define FILTER_BICUBIC 1   // Catmull-Rom cubic, 4 taps
+#define FILTER_LANCZOS 2   // Lanczos with a = 3, 6 taps
+
+// Most taps of a filter (Lanczos) and fraction bits of the tap weights
+#define FILTER_TAPS_MAX 6
+#define FILTER_BITS 14
+// Output pixels of a row that share the column tables and horizontal rows
+#define FILTER_CHUNK 256
+
+#ifdef INTERPOLATE_VERIFY
+// The verification harness sets this to compare the AVX2 passes with the scalar ones
+extern bool filter_scalar;
+#endif
+
+/**
+ * This function returns the number of taps of a separable filter, 2 for
+ * FILTER_BILINEAR.
+ * @param filter One of the FILTER_* values
+ */
+size_t filter_taps(int filter);
+
+/**
+ * This function computes the fixed-point tap weights of a filter for the
+ * offset d within a quad of size s. The output pixel at d lies at the
+ * fraction d / s between source pixel j and j + 1, tap k belongs to source
+ * pixel j - taps / 2 + 1 + k. The weights add up to 1 << FILTER_BITS, so
+ * d = 0 gives the source pixel itself.
+ * @param filter FILTER_BICUBIC or FILTER_LANCZOS
+ * @param d Offset in the quad (0 .. s - 1)
+ * @param s Scaling factor
+ * @param weights filter_taps() weights
+ */
+void filter_weights(int filter, size_t d, size_t s, int16_t *weights);
+
+/**
+ * This function is interpolate_source_rows() for a filter: it determines
+ * which source rows are needed for the output rows y .. y + h - 1. The taps
+ * reach filter_taps() / 2 rows above and below the quad.
+ * @param height Height of the source image
+ * @param scale_factor Scaling factor
+ * @param filter One of the FILTER_* values
+ * @param y First output row
+ * @param h Number of output rows
+ * @param first_row First needed source row
+ * @param row_count Number of needed source rows
+ */
+void filter_source_rows(size_t height, size_t scale_factor, int filter, size_t y, size_t h, size_t *first_row,
+                        size_t *row_count);
+
+/**
+ * This function computes a window of the grayscale image scaled with a
+ * bicubic or Lanczos filter. The filter is separable: every needed source
+ * row is filtered horizontally once into 16 bit rows with 6 fraction bits,
+ * and every output row is the vertical blend of filter_taps() of them. Both
+ * passes use tap tables that are computed once per window, and the multiply
+ * and accumulate runs on 8 (horizontal) or 16 (vertical) pixels at a time
+ * with AVX2. The source pixels outside the image repeat the edge pixels.
+ * @param gray Grayscale source rows, starting with source row first_row
+ * @param first_row Index of the first row stored in gray
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param scale_factor Scaling factor
+ * @param filter FILTER_BICUBIC or FILTER_LANCZOS
+ * @param x Left edge of the window
+ * @param y Top edge of the window
+ * @param w Width of the window
+ * @param h Height of the window
+ * @param stride Distance between two rows of result
+ * @param result Window of the scaled image
+ */
+void interpolate_region_filter(const uint8_t *gray, size_t first_row, size_t width, size_t height,
+                               size_t scale_factor, int filter, size_t x, size_t y, size_t w, size_t h,
+                               size_t stride, uint8_t *result);
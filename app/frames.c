@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "interpolate.h"
+#include "grayscale.h"
+#include "pnm.h"
+#include "pool.h"
+#include "trace.h"
+#include "frames.h"
+
+/**
+ * Buffers of one frame of a batch
+ * @param img Samples of the frame
+ * @param gray Grayscale frame
+ * @param result Interpolated frame
+ */
+struct frame_slot {
+    uint8_t *img;
+    uint8_t *gray;
+    uint8_t *result;
+};
+
+/**
+ * Batch of frames that is interpolated at the same time
+ * @param slots One slot per thread
+ * @param width, @param height Size of the frames
+ * @param channels Samples per pixel
+ * @param a, @param b, @param c Coefficients for the grayscale conversion
+ * @param scale_factor Scaling factor
+ * @param first Number of the first frame of the batch (for the trace)
+ */
+struct frame_batch {
+    struct frame_slot *slots;
+    size_t width;
+    size_t height;
+    size_t channels;
+    float a, b, c;
+    size_t scale_factor;
+    size_t first;
+};
+
+/**
+ * This function converts and interpolates one frame of the batch (pool task).
+ * @param ctx Batch (struct frame_batch)
+ * @param task Index of the slot
+ * @param worker Index of the worker
+ */
+static void frame_task(void *ctx, size_t task, size_t worker) {
+    (void)worker;
+    const struct frame_batch *batch = ctx;
+    const struct frame_slot *slot = &batch->slots[task];
+    uint64_t t = trace_begin();
+    const uint8_t *gray = slot->img;
+    if (batch->channels == 3) {
+        grayscale(slot->img, slot->gray, batch->width, batch->height, batch->a, batch->b, batch->c);
+        gray = slot->gray;
+    }
+    size_t s = batch->scale_factor;
+    interpolate_region(gray, 0, batch->width, batch->height, s, 0, 0, batch->width * s, batch->height * s,
+                       slot->result);
+    trace_end("Frame", (long)(batch->first + task), t);
+}
+
+/**
+ * This function reads the samples of the next frame, the header of the
+ * first frame has been read already.
+ * @param stream Input
+ * @param header Header of the first frame
+ * @param first This is the first frame
+ * @param img Samples
+ * @return 1 if a frame was read, 0 at the end of the input, one of the FRAMES_ERR_* values otherwise
+ */
+static int read_frame(FILE *stream, const struct pnm_header *header, bool first, uint8_t *img) {
+    if (!first) {
+        // Whitespace after the last frame (e.g. a final newline) is no further frame
+        int next;
+        while ((next = getc(stream)) != EOF && isspace(next));
+        if (next == EOF) {
+            return 0;
+        }
+        ungetc(next, stream);
+        struct pnm_header h;
+        if (pnm_read_header(stream, &h) != 0) {
+            return FRAMES_ERR_READ;
+        }
+        if (h.magic != header->magic || h.width != header->width || h.height != header->height ||
+            h.maxval != header->maxval) {
+            return FRAMES_ERR_FORMAT;
+        }
+    }
+    size_t len = header->width * header->height * pnm_channels(header);
+    return (fread(img, sizeof(uint8_t), len, stream) == len) ? 1 : FRAMES_ERR_READ;
+}
+
+int interpolate_frames(FILE *stream, const struct pnm_header *header, float a, float b, float c,
+                       size_t scale_factor, size_t threads, FILE *out, size_t *nframes) {
+    // ASCII readers buffer ahead and would consume the next header
+    if ((header->magic != '5' && header->magic != '6') || pnm_sample_bytes(header) != 1) {
+        return FRAMES_ERR_FORMAT;
+    }
+    struct frame_batch batch = {
+        .width = header->width, .height = header->height, .channels = pnm_channels(header),
+        .a = a, .b = b, .c = c, .scale_factor = scale_factor, .first = 0,
+    };
+    size_t s = scale_factor;
+    size_t reslen = batch.width * s * batch.height * s;
+    char metadata[METADATA_MAX];
+    size_t metalen = create_metadata(metadata, false, 1, 255, batch.width * s, batch.height * s);
+
+    struct pool pool;
+    if (pool_create(&pool, threads) != 0) {
+        return FRAMES_ERR_MEMORY;
+    }
+    batch.slots = calloc(threads, sizeof(struct frame_slot));
+    int ret = (batch.slots == NULL) ? FRAMES_ERR_MEMORY : 0;
+    for (size_t k = 0; k < threads && ret == 0; k++) {
+        batch.slots[k].img = malloc(batch.width * batch.height * batch.channels);
+        batch.slots[k].gray = malloc(batch.width * batch.height);
+        batch.slots[k].result = malloc(reslen);
+        if (batch.slots[k].img == NULL || batch.slots[k].gray == NULL || batch.slots[k].result == NULL) {
+            ret = FRAMES_ERR_MEMORY;
+        }
+    }
+
+    // Page cache hints: read-ahead for the next frames, consumed and written frames are dropped
+    struct pnm_cache incache;
+    struct pnm_cache outcache;
+    pnm_cache_open(&incache, stream, true, true);
+    pnm_cache_open(&outcache, out, false, true);
+
+    *nframes = 0;
+    bool end = false;
+    while (ret == 0 && !end) {
+        // Read up to one frame per thread, the frames before a read error are still written
+        size_t count = 0;
+        int err = 0;
+        while (count < threads) {
+            int got = read_frame(stream, header, *nframes + count == 0, batch.slots[count].img);
+            if (got <= 0) {
+                err = got;
+                end = true;
+                break;
+            }
+            count++;
+        }
+        if (count == 0) {
+            ret = err;
+            break;
+        }
+        pnm_cache_read(&incache, ftello(stream));
+
+        batch.first = *nframes;
+        pool_run(&pool, count, frame_task, &batch);
+
+        // Input order
+        for (size_t k = 0; k < count; k++) {
+            if (fwrite(metadata, sizeof(char), metalen, out) != metalen ||
+                fwrite(batch.slots[k].result, sizeof(uint8_t), reslen, out) != reslen) {
+                ret = FRAMES_ERR_WRITE;
+                break;
+            }
+            pnm_cache_written(&outcache, out);
+            (*nframes)++;
+        }
+        if (ret == 0) {
+            ret = err;
+        }
+    }
+
+    if (batch.slots != NULL) {
+        for (size_t k = 0; k < threads; k++) {
+            free(batch.slots[k].img);
+            free(batch.slots[k].gray);
+            free(batch.slots[k].result);
+        }
+    }
+    free(batch.slots);
+    pool_destroy(&pool);
+    return ret;
+}
@@ -0,0 +1,31 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct pnm_header;
+
+// Errors of interpolate_frames
+#define FRAMES_ERR_MEMORY -1  // Buffers or threads could not be set up
+#define FRAMES_ERR_READ -2    // A frame ended early or its header is invalid
+#define FRAMES_ERR_FORMAT -3  // A frame is no binary 8 bit image or has another size
+#define FRAMES_ERR_WRITE -4   // The output could not be written
+
+/**
+ * This function upscales a stream of concatenated binary frames (P6 or P5,
+ * e.g. ffmpeg -f image2pipe -vcodec ppm) and writes one P5 frame per input
+ * frame. All frames have the size of the first one, so the buffers of the
+ * threads slots are allocated once. The frames are read in batches of one
+ * frame per thread, every thread converts and interpolates its frame, and
+ * the batch is written in input order.
+ * @param stream Input, positioned after the header of the first frame
+ * @param header Header of the first frame
+ * @param a, @param b, @param c Coefficients for the grayscale conversion
+ * @param scale_factor Scaling factor
+ * @param threads Number of threads (frames processed at the same time)
+ * @param out Output stream
+ * @param nframes Number of frames that were written, on a read error the
+ *        frames before the failed one are written, so it failed at *nframes + 1
+ * @return 0 on success, one of the FRAMES_ERR_* values otherwise
+ */
+int interpolate_frames(FILE *stream, const struct pnm_header *header, float a, float b, float c,
+                       size_t scale_factor, size_t threads, FILE *out, size_t *nframes);
@@ -19,3 +19,18 @@ void grayscale(const uint8_t *arr_of_img, uint8_t *res_img, size_t width, size_t
     }
 }
 
+
+void grayscale16(const uint16_t *arr_of_img, uint16_t *res_img, size_t width, size_t height, float a, float b, float c) {
+    //if Coefficients are not set
+    if(a == 0 && b == 0 && c == 0){
+        a = 0.299;
+        b = 0.587;
+        c = 0.114;
+    }
+    //Convert every pixel to grayscale, a float holds every 16 bit value exactly
+    float divisor = a + b + c;
+    for (size_t i = 0; i < width * height; ++i) {
+        uint16_t gs_value = (arr_of_img[i * 3] * a + arr_of_img[i * 3 + 1] * b + arr_of_img[i * 3 + 2] * c) / divisor;
+        res_img[i] = gs_value;
+    }
+}
@@ -10,4 +10,13 @@
  * @param a, @param b, @param blength Coefficients for converting to grayscale,
  * if all three are equal to zero, default values will be used
  */
-void grayscale(const uint8_t *arr_of_img, uint8_t *res_img, size_t width, size_t height, float a, float b, float c);
\ No newline at end of file
+void grayscale(const uint8_t *arr_of_img, uint8_t *res_img, size_t width, size_t height, float a, float b, float c);
+
+/**
+ * @brief This function is grayscale() for images with 16 bit samples (maxval above 255)
+ * @param arr_of_img Array of image pixels (host byte order)
+ * @param width, @param height Image dimensions
+ * @param a, @param b, @param c Coefficients for converting to grayscale,
+ * if all three are equal to zero, default values will be used
+ */
+void grayscale16(const uint16_t *arr_of_img, uint16_t *res_img, size_t width, size_t height, float a, float b, float c);
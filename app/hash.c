@@ -0,0 +1,68 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hash.h"
+
+#define HASH_PRIME 0x100000001b3ULL
+
+// Primes of hash_block (the ones of XXH64)
+#define BLOCK_P1 0x9E3779B185EBCA87ULL
+#define BLOCK_P2 0xC2B2AE3D27D4EB4FULL
+#define BLOCK_P3 0x165667B19E3779F9ULL
+#define BLOCK_P4 0x85EBCA77C2B2AE63ULL
+#define BLOCK_P5 0x27D4EB2F165667C5ULL
+
+// Rotates x left by r bits
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * This function mixes 8 bytes of input into a lane of hash_block.
+ * @param acc Lane
+ * @param input Input
+ * @return New lane
+ */
+static inline uint64_t block_round(uint64_t acc, uint64_t input) {
+    acc += input * BLOCK_P2;
+    acc = rotl(acc, 31);
+    return acc * BLOCK_P1;
+}
+
+uint64_t hash_bytes(uint64_t h, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * HASH_PRIME;
+    }
+    return h;
+}
+
+uint64_t hash_block(uint64_t h, const uint8_t *data, size_t len) {
+    uint64_t v[4] = { h + BLOCK_P1 + BLOCK_P2, h + BLOCK_P2, h, h - BLOCK_P1 };
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * k, sizeof(word));
+            v[k] = block_round(v[k], word);
+        }
+    }
+    uint64_t acc = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18) + len;
+
+    // Rest of the block, 8 bytes and then single bytes at a time
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        acc = rotl(acc ^ block_round(0, word), 27) * BLOCK_P1 + BLOCK_P4;
+    }
+    for (; i < len; i++) {
+        acc = rotl(acc ^ (data[i] * BLOCK_P5), 11) * BLOCK_P1;
+    }
+
+    // Avalanche
+    acc ^= acc >> 33;
+    acc *= BLOCK_P2;
+    acc ^= acc >> 29;
+    acc *= BLOCK_P3;
+    acc ^= acc >> 32;
+    return acc;
+}
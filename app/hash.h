@@ -0,0 +1,29 @@
+#include <stddef.h>
+#include <stdint.h>
+
+// Start value of the hash (FNV-1a offset basis)
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+/**
+ * This function continues the 64 bit FNV-1a hash h over len bytes of data.
+ * Hashing a buffer in several parts gives the same result as hashing it at
+ * once, so the hash can be computed while the data is read.
+ * @param h Hash of the preceding data (HASH_INIT at the beginning)
+ * @param data Data to be hashed
+ * @param len Number of bytes
+ * @return Hash of the preceding data followed by data
+ */
+uint64_t hash_bytes(uint64_t h, const uint8_t *data, size_t len);
+
+/**
+ * This function hashes a block of data with the hash h of the preceding
+ * blocks as seed. It reads 32 bytes per step in four independent lanes
+ * (like XXH64), so it is several times faster than hash_bytes. The result
+ * depends on the block boundaries, the blocks have to be split the same way
+ * every time.
+ * @param h Hash of the preceding blocks (HASH_INIT at the beginning)
+ * @param data Block
+ * @param len Number of bytes
+ * @return Hash of the preceding blocks followed by data
+ */
+uint64_t hash_block(uint64_t h, const uint8_t *data, size_t len);
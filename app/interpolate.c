@@ -1,11 +1,35 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <immintrin.h>
 #include "interpolate.h"
+#include "filter.h"
+#include "layout.h"
+#include "pool.h"
+#include "trace.h"
 #include "grayscale.c"
 
+// Most planes interpolate_planes handles at once (R, G, B)
+#define MAX_PLANES 3
+// Output pixels of a color row that are interpolated before they are interleaved
+#define COLOR_CHUNK 256
+// Fraction bits of the quantized weights of the fast kernel, FAST_ONE is the weight 1.0
+#define FAST_BITS 7
+#define FAST_ONE (1 << FAST_BITS)
+// Added before the final shift of the fast kernel
+#define FAST_BIAS 0
+// Output pixels of a row that share the column tables of the fast kernel
+#define FAST_CHUNK 256
+// Smallest scaling factor whose quads are evaluated by forward differencing (s = 1 has no gaps to fill)
+#define DDA_MIN_FACTOR 2
+// Output tiles of the thread pool (--threads) and source rows per grayscale task
+#define TILE_WIDTH 256
+#define TILE_HEIGHT 32
+#define GRAY_ROWS 64
+
 
 /**
  * Еhis function is an implementation of a form of bilineal interpolation
@@ -324,7 +348,7 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
     //Loop for calculation center space pixels
     for (size_t y = 1; y < scale_factor; y++){
         int ys[4] = {(int)y, (int)y, (int)y, (int)y};
-        __m128i yi = _mm_load_si128((__m128i *)ys);
+        __m128i yi = _mm_loadu_si128((__m128i *)ys);
         for (size_t x = 1; x < scale_factor; x += 1){
             if (x + 3 >= scale_factor) {
                 res_img[index2] = matrix_formula(scale_factor, x, y, q00, qs0, q0s, qss);
@@ -333,11 +357,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
             }
 
             int xs[4] = {(int)x, (int)(x + 1), (int)(x + 2), (int)(x + 3)};
-            __m128i xi = _mm_load_si128((__m128i *)xs);
+            __m128i xi = _mm_loadu_si128((__m128i *)xs);
             __m128i r = matrix_formula_V1(nil, s, s_2, xi, yi, q00, qs0, q0s, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             res_img[index2] = n[0];
             res_img[index2 + 1] = n[1];
@@ -366,11 +390,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
             continue;
         }
         int xs[4] = {(int)counter_x, (int)(counter_x + 1), (int)(counter_x + 2), (int)(counter_x + 3)};
-        __m128i xi = _mm_load_si128((__m128i *)xs);
+        __m128i xi = _mm_loadu_si128((__m128i *)xs);
         __m128i r = matrix_formula_V1(nil, s, s_2, xi, nil, q00, qs0, q0s, qss);
 
         int n[4];
-        _mm_store_si128((__m128i *)n, r);
+        _mm_storeu_si128((__m128i *)n, r);
 
         //If has edgepixels
         if (y_index > 0){
@@ -399,11 +423,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
             continue;
         }
         int xs[4] = {(int)counter_x, (int)(counter_x + 1), (int)(counter_x + 2), (int)(counter_x + 3)};
-        __m128i xi = _mm_load_si128((__m128i *)xs);
+        __m128i xi = _mm_loadu_si128((__m128i *)xs);
         __m128i r = matrix_formula_V1(nil, s, s_2, xi, s, q00, qs0, q0s, qss);
 
         int n[4];
-        _mm_store_si128((__m128i *)n, r);
+        _mm_storeu_si128((__m128i *)n, r);
 
         res_img[x] = n[0];
         res_img[x + 1] = n[1];
@@ -424,11 +448,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
             continue;
         }
         int ys[4] = {(int)y, (int)(y + 1), (int)(y + 2), (int)(y + 3)};
-        __m128i yi = _mm_load_si128((__m128i *)ys);
+        __m128i yi = _mm_loadu_si128((__m128i *)ys);
         __m128i r = matrix_formula_V1(nil, s, s_2, s, yi, q00, qs0, q0s, qss);
 
         int n[4];
-        _mm_store_si128((__m128i *)n, r);
+        _mm_storeu_si128((__m128i *)n, r);
 
         res_img[counter_y] = n[0];
         res_img[counter_y + new_width] = n[1];
@@ -454,23 +478,23 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
             continue;
         }
         int ys[4] = {(int)y, (int)(y + 1), (int)(y + 2), (int)(y + 3)};
-        __m128i yi = _mm_load_si128((__m128i *)ys);
+        __m128i yi = _mm_loadu_si128((__m128i *)ys);
         __m128i r = matrix_formula_V1(nil, s, s_2, nil, yi, q00, qs0, q0s, qss);
 
         int n[4];
-        _mm_store_si128((__m128i *)n, r);
+        _mm_storeu_si128((__m128i *)n, r);
 
-        //If has edgepixels
-        if (y_index > 0){
+        //If has edgepixels, the 4 pixels lie below each other
+        if (x_index > 0){
             res_img[counter_y] = (res_img[counter_y] + n[0]) / 2;
-            res_img[counter_y + 1] = (res_img[counter_y + 1] + n[1]) / 2;
-            res_img[counter_y + 2] = (res_img[counter_y + 2] + n[2]) / 2;
-            res_img[counter_y + 3] = (res_img[counter_y + 3] + n[3]) / 2;
+            res_img[counter_y + new_width] = (res_img[counter_y + new_width] + n[1]) / 2;
+            res_img[counter_y + new_width * 2] = (res_img[counter_y + new_width * 2] + n[2]) / 2;
+            res_img[counter_y + new_width * 3] = (res_img[counter_y + new_width * 3] + n[3]) / 2;
         }else{
             res_img[counter_y] = n[0];
-            res_img[counter_y + 1] = n[1];
-            res_img[counter_y + 2] = n[2];
-            res_img[counter_y + 3] = n[3];
+            res_img[counter_y + new_width] = n[1];
+            res_img[counter_y + new_width * 2] = n[2];
+            res_img[counter_y + new_width * 3] = n[3];
         }
         counter_y += new_width * 4;
         y += 3;
@@ -484,7 +508,7 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
         //Loop for calculation CENTER space pixels
         for (size_t y = 1; y < scale_factor; y++){
             int ys[4] = {(int)y, (int)y, (int)y, (int)y};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             for (size_t x = 1; x < scale_factor; x += 1){
                 if (x + 3 >= scale_factor) {
                     res_img[index2] = matrix_formula(scale_factor, x, y, qs0, qs0, qss, qss);
@@ -492,11 +516,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                     continue;
                 }
                 int xs[4] = {(int)x, (int)(x + 1), (int)(x + 2), (int)(x + 3)};
-                __m128i xi = _mm_load_si128((__m128i *)xs);
+                __m128i xi = _mm_loadu_si128((__m128i *)xs);
                 __m128i r = matrix_formula_V1(nil, s, s_2, xi, yi, qs0, qs0, qss, qss);
 
                 int n[4];
-                _mm_store_si128((__m128i *)n, r);
+                _mm_storeu_si128((__m128i *)n, r);
 
                 res_img[index2] = n[0];
                 res_img[index2 + 1] = n[1];
@@ -526,11 +550,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int xs[4] = {(int)counter_x, (int)(counter_x + 1), (int)(counter_x + 2), (int)(counter_x + 3)};
-            __m128i xi = _mm_load_si128((__m128i *)xs);
+            __m128i xi = _mm_loadu_si128((__m128i *)xs);
             __m128i r = matrix_formula_V1(nil, s, s_2, xi, nil, qs0, qs0, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             //If has edgepixels
             if (y_index > 0){
@@ -561,11 +585,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int xs[4] = {(int)counter_x, (int)(counter_x + 1), (int)(counter_x + 2), (int)(counter_x + 3)};
-            __m128i xi = _mm_load_si128((__m128i *)xs);
+            __m128i xi = _mm_loadu_si128((__m128i *)xs);
             __m128i r = matrix_formula_V1(nil, s, s_2, xi, s, qs0, qs0, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             res_img[x] = n[0];
             res_img[x + 1] = n[1];
@@ -586,11 +610,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int ys[4] = {(int)y, (int)(y + 1), (int)(y + 2), (int)(y + 3)};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             __m128i r = matrix_formula_V1(nil, s, s_2, s, yi, qs0, qs0, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             res_img[counter_y] = n[0];
             res_img[counter_y + new_width] = n[1];
@@ -611,7 +635,7 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
         //Loop for calculation CENTER space pixels
         for (size_t y = 1; y < scale_factor; y++){
             int ys[4] = {(int)y, (int)y, (int)y, (int)y};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             for (size_t x = 1; x < scale_factor; x += 1){
                 if (x + 3 >= scale_factor) {
                     res_img[index2] = matrix_formula(scale_factor, x, y, q0s, q0s, qss, qss);
@@ -619,11 +643,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                     continue;
                 }
                 int xs[4] = {(int)x, (int)(x + 1), (int)(x + 2), (int)(x + 3)};
-                __m128i xi = _mm_load_si128((__m128i *)xs);
+                __m128i xi = _mm_loadu_si128((__m128i *)xs);
                 __m128i r = matrix_formula_V1(nil, s, s_2, xi, yi, q0s, q0s, qss, qss);
 
                 int n[4];
-                _mm_store_si128((__m128i *)n, r);
+                _mm_storeu_si128((__m128i *)n, r);
 
                 res_img[index2] = n[0];
                 res_img[index2 + 1] = n[1];
@@ -648,11 +672,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int xs[4] = {(int)counter_x, (int)(counter_x + 1), (int)(counter_x + 2), (int)(counter_x + 3)};
-            __m128i xi = _mm_load_si128((__m128i *)xs);
+            __m128i xi = _mm_loadu_si128((__m128i *)xs);
             __m128i r = matrix_formula_V1(nil, s, s_2, xi, s, q0s, q0s, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             res_img[x] = n[0];
             res_img[x + 1] = n[1];
@@ -678,23 +702,23 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int ys[4] = {(int)y, (int)(y + 1), (int)(y + 2), (int)(y + 3)};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             __m128i r = matrix_formula_V1(nil, s, s_2, nil, yi, q0s, q0s, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
-            //If has edgepixels
-            if (y_index > 0){
+            //If has edgepixels, the 4 pixels lie below each other
+            if (x_index > 0){
                 res_img[counter_y] = (res_img[counter_y] + n[0]) / 2;
-                res_img[counter_y + 1] = (res_img[counter_y + 1] + n[1]) / 2;
-                res_img[counter_y + 2] = (res_img[counter_y + 2] + n[2]) / 2;
-                res_img[counter_y + 3] = (res_img[counter_y + 3] + n[3]) / 2;
+                res_img[counter_y + new_width] = (res_img[counter_y + new_width] + n[1]) / 2;
+                res_img[counter_y + new_width * 2] = (res_img[counter_y + new_width * 2] + n[2]) / 2;
+                res_img[counter_y + new_width * 3] = (res_img[counter_y + new_width * 3] + n[3]) / 2;
             }else{
                 res_img[counter_y] = n[0];
-                res_img[counter_y + 1] = n[1];
-                res_img[counter_y + 2] = n[2];
-                res_img[counter_y + 3] = n[3];
+                res_img[counter_y + new_width] = n[1];
+                res_img[counter_y + new_width * 2] = n[2];
+                res_img[counter_y + new_width * 3] = n[3];
             }
             counter_y += new_width * 4;
             y += 3;
@@ -711,11 +735,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                 continue;
             }
             int ys[4] = {(int)y, (int)(y + 1), (int)(y + 2), (int)(y + 3)};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             __m128i r = matrix_formula_V1(nil, s, s_2, s, yi, q0s, q0s, qss, qss);
 
             int n[4];
-            _mm_store_si128((__m128i *)n, r);
+            _mm_storeu_si128((__m128i *)n, r);
 
             res_img[counter_y] = n[0];
             res_img[counter_y + new_width] = n[1];
@@ -735,7 +759,7 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
         //Loop for calculation CENTER space pixels
         for (size_t y = 1; y < scale_factor; y++){
             int ys[4] = {(int)y, (int)y, (int)y, (int)y};
-            __m128i yi = _mm_load_si128((__m128i *)ys);
+            __m128i yi = _mm_loadu_si128((__m128i *)ys);
             for (size_t x = 1; x < scale_factor; x += 1){
                 if (x + 3 >= scale_factor) {
                     res_img[index2] = matrix_formula(scale_factor, x, y, qss, qss, qss, qss);
@@ -743,11 +767,11 @@ void interpolate_small_V1(__m128i nil, __m128i s, __m128i s_2, size_t scale_fact
                     continue;
                 }
                 int xs[4] = {(int)x, (int)(x + 1), (int)(x + 2), (int)(x + 3)};
-                __m128i xi = _mm_load_si128((__m128i *)xs);
+                __m128i xi = _mm_loadu_si128((__m128i *)xs);
                 __m128i r = matrix_formula_V1(nil, s, s_2, xi, yi, qss, qss, qss, qss);
 
                 int n[4];
-                _mm_store_si128((__m128i *)n, r);
+                _mm_storeu_si128((__m128i *)n, r);
 
                 res_img[index2] = n[0];
                 res_img[index2 + 1] = n[1];
@@ -767,6 +791,16 @@ void interpolate(const uint8_t *img, size_t width, size_t height, float a, float
     //First turn the image to grayscale, the result is saved in tmp array
     grayscale(img, tmp, width, height, a, b, c);
 
+    interpolate_gray(tmp, width, height, scale_factor, result);
+}
+
+void interpolate_gray(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+    interpolate_place(tmp, width, height, scale_factor, result);
+    interpolate_quads(tmp, width, height, scale_factor, result);
+}
+
+void interpolate_place(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+
     //Тew image characteristics
     size_t new_width = width * scale_factor;
     size_t new_height = height * scale_factor;
@@ -781,6 +815,11 @@ void interpolate(const uint8_t *img, size_t width, size_t height, float a, float
             counter += 1;
         }
     }
+}
+
+void interpolate_quads(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+
+    size_t new_width = width * scale_factor;
 
     //Index of top right corner pixel
     size_t index = 0;
@@ -813,29 +852,26 @@ void interpolate_V1(const uint8_t *img,
     //First turn the image to grayscale, the result is saved in tmp array
     grayscale(img, tmp, width, height, a, b, c);
 
-    //Тew image characteristics
-    size_t new_width = width * scale_factor;
-    size_t new_height = height * scale_factor;
+    interpolate_gray_V1(tmp, width, height, scale_factor, result);
+}
 
-    //The existing pixels are moved to their new positions. The resulting gaps are marked by black pixels:
-    size_t counter = 0;
-    size_t ss = new_height * new_width;
-    size_t step = scale_factor * new_width;
-    for (size_t i = 0; i < ss; i += step){
-        for (size_t j = 0; j < width; ++j){
-            result[i + scale_factor * j] = tmp[counter];
-            counter += 1;
-        }
-    }
+void interpolate_gray_V1(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+    interpolate_place(tmp, width, height, scale_factor, result);
+    interpolate_quads_V1(tmp, width, height, scale_factor, result);
+}
+
+void interpolate_quads_V1(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+
+    size_t new_width = width * scale_factor;
 
     // Init 128bit registers
     int scalef2 = (int)(scale_factor * scale_factor);
     int nil[4] = {0, 0, 0, 0};
     int sf[4] = {(int)scale_factor, (int)scale_factor, (int)scale_factor, (int)scale_factor};
     int sf2[4] = {scalef2, scalef2, scalef2, scalef2};
-    __m128i null = _mm_load_si128((__m128i *)nil);
-    __m128i s = _mm_load_si128((__m128i *)sf);
-    __m128i s_2 = _mm_load_si128((__m128i *)sf2);
+    __m128i null = _mm_loadu_si128((__m128i *)nil);
+    __m128i s = _mm_loadu_si128((__m128i *)sf);
+    __m128i s_2 = _mm_loadu_si128((__m128i *)sf2);
 
     //Index of top right corner pixel
     size_t index = 0;
@@ -857,57 +893,1318 @@ void interpolate_V1(const uint8_t *img,
 }
 
 
+void interpolate_V2(const uint8_t *img, size_t width, size_t height, float a, float b, float c, size_t scale_factor,
+                    uint8_t *tmp, uint8_t *result){
+    //First turn the image to grayscale, the result is saved in tmp array
+    grayscale(img, tmp, width, height, a, b, c);
+
+    interpolate_gray_V2(tmp, width, height, scale_factor, result);
+}
+
+void interpolate_gray_V2(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result){
+    interpolate_region(tmp, 0, width, height, scale_factor, 0, 0, width * scale_factor, height * scale_factor, result);
+}
+
+void interpolate_source_rows(size_t height, size_t scale_factor, size_t y, size_t h, size_t *first_row, size_t *row_count){
+    //Quad rows of the first and the last output row, plus the row below the last quad
+    size_t first = y / scale_factor;
+    size_t last = (y + h - 1) / scale_factor + 1;
+    if (last > height - 1){
+        last = height - 1;
+    }
+    *first_row = first;
+    *row_count = last - first + 1;
+}
+
+/**
+ * This function computes a part of one of the last scale_factor output rows,
+ * which lie below the last row of quads. interpolate_small fills them with the
+ * blend of two neighbouring pixels of the last source row, stepping along y,
+ * and averages the values of neighbouring quads on the quad borders.
+ * @param last Last row of the grayscale source image
+ * @param width Width of the source image
+ * @param s Scaling factor
+ * @param dy Output row relative to the last source row (0 .. s - 1)
+ * @param x Left edge of the part
+ * @param w Width of the part
+ * @param out Output pixels
+ */
+static void interpolate_last_row(const uint8_t *last, size_t width, size_t s, size_t dy, size_t x, size_t w, uint8_t *out){
+    for (size_t col = 0; col < w; col++){
+        size_t j = (x + col) / s;
+        size_t dx = (x + col) % s;
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+
+        //Last grid row, the space pixels take the value of the right corner pixel
+        if (dy == 0){
+            out[col] = (dx == 0) ? last[j] : last[j1];
+            continue;
+        }
+
+        size_t f = ((s - dy) * last[j] + dy * last[j1]) / s;
+        if (dx == 0 && j > 0){
+            size_t f_left = ((s - dy) * last[j - 1] + dy * last[j]) / s;
+            //Border between two quads, the last column only gets the value of its left quad
+            f = (j1 == j) ? f_left : (f_left + f) / 2;
+        }
+        out[col] = (uint8_t)f;
+    }
+}
+
+/**
+ * Exact reciprocal of s * s: every numerator n of matrix_formula (below
+ * 256 * s * s) gives n / (s * s) == (n * mul) >> shift.
+ * @param mul Multiplier, ceil(2^shift / (s * s))
+ * @param shift Shift
+ */
+struct dda_div {
+    uint64_t mul;
+    unsigned shift;
+};
+
+/**
+ * This function computes the reciprocal of s * s for the forward
+ * differencing of interpolate_planes. With numerators below 2^bits and
+ * shift = bits + ceil(log2(s * s)), the multiplier has bits + 1 bits, so
+ * n * mul stays below 2^64 as long as the numerators fit into 31 bits.
+ * @param s Scaling factor
+ * @param div Reciprocal
+ * @return false if the factor is too large for 64 bit products
+ */
+static bool dda_setup(size_t s, struct dda_div *div){
+    uint64_t d = (uint64_t)s * s;
+    unsigned bits = 64 - (unsigned)__builtin_clzll(255 * d);
+    unsigned log = (d > 1) ? 64 - (unsigned)__builtin_clzll(d - 1) : 0;
+    if (bits > 31){
+        return false;
+    }
+    div->shift = bits + log;
+    div->mul = ((1ull << div->shift) + d - 1) / d;
+    return true;
+}
+
+/**
+ * This function computes a part of an output row with forward differencing.
+ * Within a quad the numerator of matrix_formula grows by the same step
+ * (right - left) from pixel to pixel. Multiplied by the reciprocal of s * s
+ * the numerator and the step stay exact integers, so every pixel is one
+ * 64 bit add and one shift, four pixels per AVX2 register. The result is
+ * identical to matrix_formula.
+ * @param r0 Upper source row of the quads
+ * @param r1 Lower source row of the quads
+ * @param width Width of the source image
+ * @param s Scaling factor
+ * @param dy Output row within the quads (0 .. s - 1)
+ * @param x Left edge of the part
+ * @param w Width of the part
+ * @param div Reciprocal of s * s
+ * @param out Output pixels
+ */
+__attribute__((target("avx2")))
+static void dda_row_avx2(const uint8_t *r0, const uint8_t *r1, size_t width, size_t s, size_t dy, size_t x,
+                         size_t w, const struct dda_div *div, uint8_t *out){
+    __m256i low = _mm256_set_epi32(0, 0, 0, 0, 6, 4, 2, 0);
+    size_t j = x / s;
+    size_t dx = x % s;
+    size_t col = 0;
+    while (col < w){
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+        uint64_t left = (s - dy) * r0[j] + dy * r1[j];
+        uint64_t right = (s - dy) * r0[j1] + dy * r1[j1];
+        //The step is negative for falling values, the sums wrap around to the exact products
+        uint64_t step = (right - left) * div->mul;
+        uint64_t acc = (s * left + dx * (right - left)) * div->mul;
+        size_t n = (s - dx < w - col) ? s - dx : w - col;
+        uint8_t *o = out + col;
+
+        size_t t = 0;
+        if (n >= 8){
+            __m256i a0 = _mm256_set_epi64x((long long)(acc + 3 * step), (long long)(acc + 2 * step),
+                                           (long long)(acc + step), (long long)acc);
+            __m256i a1 = _mm256_add_epi64(a0, _mm256_set1_epi64x((long long)(4 * step)));
+            __m256i step8 = _mm256_set1_epi64x((long long)(8 * step));
+            for (; t + 8 <= n; t += 8){
+                //The low dwords of the shifted products are the pixels
+                __m256i q0 = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(a0, (int)div->shift), low);
+                __m256i q1 = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(a1, (int)div->shift), low);
+                __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(q0), _mm256_castsi256_si128(q1));
+                _mm_storel_epi64((__m128i *)(o + t), _mm_packus_epi16(words, words));
+                a0 = _mm256_add_epi64(a0, step8);
+                a1 = _mm256_add_epi64(a1, step8);
+            }
+            acc += t * step;
+        }
+        for (; t < n; t++){
+            o[t] = (uint8_t)(acc >> div->shift);
+            acc += step;
+        }
+
+        col += n;
+        dx = 0;
+        j = j1;
+    }
+}
+
+/**
+ * Scalar version of dda_row_avx2 for CPUs without AVX2.
+ */
+static void dda_row_scalar(const uint8_t *r0, const uint8_t *r1, size_t width, size_t s, size_t dy, size_t x,
+                           size_t w, const struct dda_div *div, uint8_t *out){
+    size_t j = x / s;
+    size_t dx = x % s;
+    size_t col = 0;
+    while (col < w){
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+        uint64_t left = (s - dy) * r0[j] + dy * r1[j];
+        uint64_t right = (s - dy) * r0[j1] + dy * r1[j1];
+        uint64_t step = (right - left) * div->mul;
+        uint64_t acc = (s * left + dx * (right - left)) * div->mul;
+        size_t n = (s - dx < w - col) ? s - dx : w - col;
+        for (size_t t = 0; t < n; t++){
+            out[col + t] = (uint8_t)(acc >> div->shift);
+            acc += step;
+        }
+        col += n;
+        dx = 0;
+        j = j1;
+    }
+}
+
+/**
+ * This function is interpolate_region for up to MAX_PLANES planes of the same
+ * size. The quad, the weights and the edge handling of an output pixel are
+ * computed once and applied to every plane.
+ * @param planes First plane, the others follow at a distance of plane_len
+ * @param plane_len Length of a plane
+ * @param nplanes Number of planes
+ * @param stride Distance between two output rows
+ * @param result Output, row r of plane c starts at result + r * stride + c * w
+ */
+static inline void interpolate_planes(const uint8_t *planes, size_t plane_len, size_t nplanes, size_t first_row,
+                                      size_t width, size_t height, size_t scale_factor, size_t x, size_t y, size_t w,
+                                      size_t h, size_t stride, uint8_t *result){
+    size_t s = scale_factor;
+    size_t s_2 = s * s;
+    //The quads are evaluated by forward differencing up to the factors whose products no longer fit into 64 bit
+    struct dda_div div;
+    bool dda = s >= DDA_MIN_FACTOR && dda_setup(s, &div);
+    bool avx2 = dda && __builtin_cpu_supports("avx2");
+
+    for (size_t row = 0; row < h; row++){
+        //Quad of the output row, the last source row/column is repeated at the edges
+        size_t i = (y + row) / s;
+        size_t dy = (y + row) % s;
+        size_t i1 = (i + 1 < height) ? i + 1 : i;
+        const uint8_t *r0 = planes + (i - first_row) * width;
+        const uint8_t *r1 = planes + (i1 - first_row) * width;
+        uint8_t *out = result + row * stride;
+
+        if (i == height - 1 && height > 1){
+            for (size_t c = 0; c < nplanes; c++){
+                interpolate_last_row(r0 + c * plane_len, width, s, dy, x, w, out + c * w);
+            }
+            continue;
+        }
+        if (dda){
+            for (size_t c = 0; c < nplanes; c++){
+                if (avx2){
+                    dda_row_avx2(r0 + c * plane_len, r1 + c * plane_len, width, s, dy, x, w, &div, out + c * w);
+                }
+                else {
+                    dda_row_scalar(r0 + c * plane_len, r1 + c * plane_len, width, s, dy, x, w, &div, out + c * w);
+                }
+            }
+            continue;
+        }
+
+        //Vertical blend of the left and right column of the current quad
+        size_t j = x / s;
+        size_t dx = x % s;
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+        size_t left[MAX_PLANES];
+        size_t right[MAX_PLANES];
+        for (size_t c = 0; c < nplanes; c++){
+            left[c] = (s - dy) * r0[c * plane_len + j] + dy * r1[c * plane_len + j];
+            right[c] = (s - dy) * r0[c * plane_len + j1] + dy * r1[c * plane_len + j1];
+        }
+
+        for (size_t col = 0; col < w; col++){
+            //Same arithmetic as matrix_formula
+            for (size_t c = 0; c < nplanes; c++){
+                out[c * w + col] = (uint8_t)(((s - dx) * left[c] + dx * right[c]) / s_2);
+            }
+            if (++dx == s){
+                dx = 0;
+                j = j1;
+                j1 = (j + 1 < width) ? j + 1 : j;
+                for (size_t c = 0; c < nplanes; c++){
+                    left[c] = right[c];
+                    right[c] = (s - dy) * r0[c * plane_len + j1] + dy * r1[c * plane_len + j1];
+                }
+            }
+        }
+    }
+}
+
+void interpolate_region(const uint8_t *gray, size_t first_row, size_t width, size_t height, size_t scale_factor,
+                        size_t x, size_t y, size_t w, size_t h, uint8_t *result){
+    interpolate_planes(gray, 0, 1, first_row, width, height, scale_factor, x, y, w, h, w, result);
+}
+
+void interpolate_tile(const uint8_t *gray, size_t first_row, size_t width, size_t height, size_t scale_factor,
+                      size_t x, size_t y, size_t w, size_t h, size_t stride, uint8_t *result){
+    interpolate_planes(gray, 0, 1, first_row, width, height, scale_factor, x, y, w, h, stride, result);
+}
+
+void interpolate_roi(const uint8_t *img, size_t first_row, size_t width, size_t height, float a, float b, float c,
+                     size_t scale_factor, size_t x, size_t y, size_t w, size_t h, uint8_t *tmp, uint8_t *result){
+    size_t first, rows;
+    interpolate_source_rows(height, scale_factor, y, h, &first, &rows);
+
+    //Only the rows the window depends on are converted to grayscale
+    grayscale(img + (first - first_row) * width * 3, tmp, width, rows, a, b, c);
+
+    interpolate_region(tmp, first, width, height, scale_factor, x, y, w, h, result);
+}
+
+void interpolate_rows(const uint8_t *gray, size_t first_row, size_t width, size_t height, const size_t *factors,
+                      size_t nfactors, size_t i, bool fast, uint8_t **bands){
+    for (size_t k = 0; k < nfactors; k++){
+        size_t s = factors[k];
+        if (fast){
+            interpolate_region_fast(gray, first_row, width, height, s, 0, i * s, width * s, s, bands[k]);
+        }
+        else {
+            interpolate_region(gray, first_row, width, height, s, 0, i * s, width * s, s, bands[k]);
+        }
+    }
+}
+
+/**
+ * This function returns the weight of offset d within a quad of size s for
+ * the fast kernel, rounded to FAST_BITS fraction bits (0 .. FAST_ONE).
+ */
+static inline size_t fast_weight(size_t d, size_t s){
+    return (2 * d * FAST_ONE + s) / (2 * s);
+}
+
+/**
+ * This function blends two source rows with the quantized weights
+ * FAST_ONE - wy and wy. The two rows are interleaved byte by byte, so one
+ * pmaddubsw multiplies both pixels of 8 columns with their weight and adds
+ * them. pmaddubsw takes signed pixels, so they are moved by -128 and the
+ * result is corrected afterwards.
+ * @param r0 Upper row
+ * @param r1 Lower row
+ * @param n Number of columns
+ * @param wy Weight of the lower row
+ * @param v Blended columns, FAST_ONE times the exact blend
+ */
+__attribute__((target("ssse3")))
+static void fast_vertical_ssse3(const uint8_t *r0, const uint8_t *r1, size_t n, size_t wy, int16_t *v){
+    __m128i weights = _mm_set1_epi16((short)((wy << 8) | (FAST_ONE - wy)));
+    __m128i flip = _mm_set1_epi8((char)0x80);
+    __m128i offset = _mm_set1_epi16(FAST_ONE * 128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16){
+        __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r0 + i)), flip);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r1 + i)), flip);
+        __m128i lo = _mm_add_epi16(_mm_maddubs_epi16(weights, _mm_unpacklo_epi8(a, b)), offset);
+        __m128i hi = _mm_add_epi16(_mm_maddubs_epi16(weights, _mm_unpackhi_epi8(a, b)), offset);
+        _mm_storeu_si128((__m128i *)(v + i), lo);
+        _mm_storeu_si128((__m128i *)(v + i + 8), hi);
+    }
+    for (; i < n; i++){
+        v[i] = (int16_t)((FAST_ONE - wy) * r0[i] + wy * r1[i]);
+    }
+}
+
+/**
+ * Scalar version of fast_vertical_ssse3 for CPUs without SSSE3.
+ */
+static void fast_vertical_scalar(const uint8_t *r0, const uint8_t *r1, size_t n, size_t wy, int16_t *v){
+    for (size_t i = 0; i < n; i++){
+        v[i] = (int16_t)((FAST_ONE - wy) * r0[i] + wy * r1[i]);
+    }
+}
+
+/**
+ * This function blends neighbouring blended columns into the output pixels.
+ * Both columns of an output pixel are loaded as one pair of 16 bit values,
+ * pmaddwd multiplies them with the pair of weights of the pixel and adds
+ * them, and a shift replaces the division.
+ * @param v Blended columns (with one repeated column at the end)
+ * @param jtab Left column of every output pixel
+ * @param wtab Weights of every output pixel (FAST_ONE - wx in the low half, wx in the high half)
+ * @param n Number of output pixels
+ * @param out Output pixels
+ */
+static void fast_horizontal(const int16_t *v, const uint32_t *jtab, const int32_t *wtab, size_t n, uint8_t *out){
+    __m128i bias = _mm_set1_epi32(FAST_BIAS);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8){
+        int32_t p[8];
+        for (int t = 0; t < 8; t++){
+            memcpy(&p[t], v + jtab[k + t], sizeof(int32_t));
+        }
+        __m128i lo = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)p), _mm_loadu_si128((const __m128i *)(wtab + k)));
+        __m128i hi = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(p + 4)),
+                                    _mm_loadu_si128((const __m128i *)(wtab + k + 4)));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, bias), 2 * FAST_BITS);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, bias), 2 * FAST_BITS);
+        __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i *)(out + k), _mm_packus_epi16(words, words));
+    }
+    for (; k < n; k++){
+        int32_t wx = wtab[k] >> 16;
+        int32_t acc = v[jtab[k]] * (FAST_ONE - wx) + v[jtab[k] + 1] * wx;
+        out[k] = (uint8_t)((acc + FAST_BIAS) >> (2 * FAST_BITS));
+    }
+}
+
+void interpolate_region_fast(const uint8_t *gray, size_t first_row, size_t width, size_t height, size_t scale_factor,
+                             size_t x, size_t y, size_t w, size_t h, uint8_t *result){
+    size_t s = scale_factor;
+    bool ssse3 = __builtin_cpu_supports("ssse3");
+    uint32_t jtab[FAST_CHUNK];
+    int32_t wtab[FAST_CHUNK];
+    int16_t v[FAST_CHUNK + 2];
+
+    //The column tables of a chunk are shared by all rows
+    for (size_t cx = 0; cx < w; cx += FAST_CHUNK){
+        size_t cw = (w - cx < FAST_CHUNK) ? w - cx : FAST_CHUNK;
+        size_t j0 = (x + cx) / s;
+        size_t jend = (x + cx + cw - 1) / s + 1;
+        if (jend > width - 1){
+            jend = width - 1;
+        }
+        size_t ncols = jend - j0 + 1;
+        for (size_t col = 0; col < cw; col++){
+            size_t wx = fast_weight((x + cx + col) % s, s);
+            jtab[col] = (uint32_t)((x + cx + col) / s - j0);
+            wtab[col] = (int32_t)((wx << 16) | (FAST_ONE - wx));
+        }
+
+        for (size_t row = 0; row < h; row++){
+            size_t i = (y + row) / s;
+            size_t dy = (y + row) % s;
+            size_t i1 = (i + 1 < height) ? i + 1 : i;
+            const uint8_t *r0 = gray + (i - first_row) * width;
+            const uint8_t *r1 = gray + (i1 - first_row) * width;
+            uint8_t *out = result + row * w + cx;
+
+            //The rows below the last quad row are few and keep the exact values
+            if (i == height - 1 && height > 1){
+                interpolate_last_row(r0, width, s, dy, x + cx, cw, out);
+                continue;
+            }
+
+            size_t wy = fast_weight(dy, s);
+            if (ssse3){
+                fast_vertical_ssse3(r0 + j0, r1 + j0, ncols, wy, v);
+            }
+            else {
+                fast_vertical_scalar(r0 + j0, r1 + j0, ncols, wy, v);
+            }
+            //The last column is repeated for the right edge
+            v[ncols] = v[ncols - 1];
+            fast_horizontal(v, jtab, wtab, cw, out);
+        }
+    }
+}
+
+/**
+ * This function is interpolate_last_row for 16 bit samples.
+ */
+static void interpolate_last_row16(const uint16_t *last, size_t width, size_t s, size_t dy, size_t x, size_t w,
+                                   uint16_t *out){
+    for (size_t col = 0; col < w; col++){
+        size_t j = (x + col) / s;
+        size_t dx = (x + col) % s;
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+
+        if (dy == 0){
+            out[col] = (dx == 0) ? last[j] : last[j1];
+            continue;
+        }
+
+        size_t f = ((s - dy) * last[j] + dy * last[j1]) / s;
+        if (dx == 0 && j > 0){
+            size_t f_left = ((s - dy) * last[j - 1] + dy * last[j]) / s;
+            f = (j1 == j) ? f_left : (f_left + f) / 2;
+        }
+        out[col] = (uint16_t)f;
+    }
+}
+
+void interpolate_region16(const uint16_t *gray, size_t first_row, size_t width, size_t height, size_t scale_factor,
+                          size_t x, size_t y, size_t w, size_t h, uint16_t *result){
+    size_t s = scale_factor;
+    size_t s_2 = s * s;
+
+    for (size_t row = 0; row < h; row++){
+        size_t i = (y + row) / s;
+        size_t dy = (y + row) % s;
+        size_t i1 = (i + 1 < height) ? i + 1 : i;
+        const uint16_t *r0 = gray + (i - first_row) * width;
+        const uint16_t *r1 = gray + (i1 - first_row) * width;
+        uint16_t *out = result + row * w;
+
+        if (i == height - 1 && height > 1){
+            interpolate_last_row16(r0, width, s, dy, x, w, out);
+            continue;
+        }
+
+        //The products need more than 32 bit for large factors, so they stay size_t as in matrix_formula
+        size_t j = x / s;
+        size_t dx = x % s;
+        size_t j1 = (j + 1 < width) ? j + 1 : j;
+        size_t left = (s - dy) * r0[j] + dy * r1[j];
+        size_t right = (s - dy) * r0[j1] + dy * r1[j1];
+
+        for (size_t col = 0; col < w; col++){
+            out[col] = (uint16_t)(((s - dx) * left + dx * right) / s_2);
+            if (++dx == s){
+                dx = 0;
+                j = j1;
+                j1 = (j + 1 < width) ? j + 1 : j;
+                left = right;
+                right = (s - dy) * r0[j1] + dy * r1[j1];
+            }
+        }
+    }
+}
+
+/**
+ * This function splits count RGB pixels into three planes with SSSE3
+ * shuffles: every 16 pixels of a plane are gathered from the three 16 byte
+ * blocks they lie in.
+ * @param rgb Interleaved pixels
+ * @param count Number of pixels
+ * @param planes Output planes, plane c starts at planes + c * plane_len
+ * @param plane_len Length of a plane
+ */
+__attribute__((target("ssse3")))
+static void deinterleave_ssse3(const uint8_t *rgb, size_t count, uint8_t *planes, size_t plane_len){
+    //Byte i of plane c is byte 3 * i + c of the 48 input bytes
+    __m128i masks[3][3];
+    for (int c = 0; c < 3; c++){
+        for (int t = 0; t < 3; t++){
+            int8_t m[16];
+            for (int i = 0; i < 16; i++){
+                int k = 3 * i + c;
+                m[i] = (k / 16 == t) ? (int8_t)(k % 16) : (int8_t)0x80;
+            }
+            masks[c][t] = _mm_loadu_si128((const __m128i *)m);
+        }
+    }
+
+    size_t p = 0;
+    for (; p + 16 <= count; p += 16){
+        __m128i in0 = _mm_loadu_si128((const __m128i *)(rgb + 3 * p));
+        __m128i in1 = _mm_loadu_si128((const __m128i *)(rgb + 3 * p + 16));
+        __m128i in2 = _mm_loadu_si128((const __m128i *)(rgb + 3 * p + 32));
+        for (int c = 0; c < 3; c++){
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, masks[c][0]), _mm_shuffle_epi8(in1, masks[c][1])),
+                                     _mm_shuffle_epi8(in2, masks[c][2]));
+            _mm_storeu_si128((__m128i *)(planes + c * plane_len + p), v);
+        }
+    }
+    for (; p < count; p++){
+        for (int c = 0; c < 3; c++){
+            planes[c * plane_len + p] = rgb[3 * p + c];
+        }
+    }
+}
+
+/**
+ * This function merges three planes of count pixels into RGB pixels, it is
+ * the inverse of deinterleave_ssse3.
+ * @param planes Input planes, plane c starts at planes + c * plane_len
+ * @param plane_len Length of a plane
+ * @param count Number of pixels
+ * @param rgb Interleaved pixels
+ */
+__attribute__((target("ssse3")))
+static void interleave_ssse3(const uint8_t *planes, size_t plane_len, size_t count, uint8_t *rgb){
+    //Byte k of the 48 output bytes is byte k / 3 of plane k % 3
+    __m128i masks[3][3];
+    for (int t = 0; t < 3; t++){
+        for (int c = 0; c < 3; c++){
+            int8_t m[16];
+            for (int i = 0; i < 16; i++){
+                int k = 16 * t + i;
+                m[i] = (k % 3 == c) ? (int8_t)(k / 3) : (int8_t)0x80;
+            }
+            masks[t][c] = _mm_loadu_si128((const __m128i *)m);
+        }
+    }
+
+    size_t p = 0;
+    for (; p + 16 <= count; p += 16){
+        __m128i r = _mm_loadu_si128((const __m128i *)(planes + p));
+        __m128i g = _mm_loadu_si128((const __m128i *)(planes + plane_len + p));
+        __m128i b = _mm_loadu_si128((const __m128i *)(planes + 2 * plane_len + p));
+        for (int t = 0; t < 3; t++){
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, masks[t][0]), _mm_shuffle_epi8(g, masks[t][1])),
+                                     _mm_shuffle_epi8(b, masks[t][2]));
+            _mm_storeu_si128((__m128i *)(rgb + 3 * p + 16 * t), v);
+        }
+    }
+    for (; p < count; p++){
+        for (int c = 0; c < 3; c++){
+            rgb[3 * p + c] = planes[c * plane_len + p];
+        }
+    }
+}
+
+/**
+ * Scalar versions of the two functions above for CPUs without SSSE3.
+ */
+static void deinterleave_scalar(const uint8_t *rgb, size_t count, uint8_t *planes, size_t plane_len){
+    for (size_t p = 0; p < count; p++){
+        for (int c = 0; c < 3; c++){
+            planes[c * plane_len + p] = rgb[3 * p + c];
+        }
+    }
+}
+
+static void interleave_scalar(const uint8_t *planes, size_t plane_len, size_t count, uint8_t *rgb){
+    for (size_t p = 0; p < count; p++){
+        for (int c = 0; c < 3; c++){
+            rgb[3 * p + c] = planes[c * plane_len + p];
+        }
+    }
+}
 
-int main(){
+void interpolate_color(const uint8_t *img, size_t first_row, size_t width, size_t height, size_t scale_factor,
+                       size_t x, size_t y, size_t w, size_t h, uint8_t *planes, uint8_t *result){
+    bool ssse3 = __builtin_cpu_supports("ssse3");
+    size_t first, rows;
+    interpolate_source_rows(height, scale_factor, y, h, &first, &rows);
+
+    //Split the needed source rows into an R, a G and a B plane
+    size_t plane_len = width * rows;
+    const uint8_t *src = img + (first - first_row) * width * 3;
+    if (ssse3){
+        deinterleave_ssse3(src, plane_len, planes, plane_len);
+    }
+    else {
+        deinterleave_scalar(src, plane_len, planes, plane_len);
+    }
+
+    //Every output row is computed in chunks that stay in L1, the three planes of a chunk are then interleaved
+    uint8_t chunk[3 * COLOR_CHUNK];
+    for (size_t row = 0; row < h; row++){
+        for (size_t cx = 0; cx < w; cx += COLOR_CHUNK){
+            size_t cw = (w - cx < COLOR_CHUNK) ? w - cx : COLOR_CHUNK;
+            interpolate_planes(planes, plane_len, 3, first, width, height, scale_factor, x + cx, y + row, cw, 1,
+                               3 * cw, chunk);
+            uint8_t *out = result + (row * w + cx) * 3;
+            if (ssse3){
+                interleave_ssse3(chunk, cw, cw, out);
+            }
+            else {
+                interleave_scalar(chunk, cw, cw, out);
+            }
+        }
+    }
+}
+
+
+/**
+ * Work of the thread pool: the grayscale conversion of the source rows and
+ * the tiles of the output window
+ * @param img Source rows that were read
+ * @param first_row Index of the first source row in img
+ * @param gray_first First source row the window depends on
+ * @param gray_rows Number of source rows the window depends on
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param coeffs Coefficients for the grayscale conversion
+ * @param gray Grayscale rows, starting with source row gray_first
+ * @param scalFac Scaling factor
+ * @param filter Resampling filter (FILTER_*)
+ * @param x, @param y, @param w, @param h Window of the output image
+ * @param tile_w, @param tile_h Size of the tiles
+ * @param layout Edge length of the tiles of the tiled output layout, 0 for row-major output
+ * @param cols Number of tile columns
+ * @param ntiles Number of tiles
+ * @param pool Thread pool
+ * @param result Output image (w * h)
+ */
+struct tile_job {
+    const uint8_t *img;
+    size_t first_row;
+    size_t gray_first;
+    size_t gray_rows;
+    size_t width;
+    size_t height;
+    const float *coeffs;
+    uint8_t *gray;
+    size_t scalFac;
+    int filter;
+    size_t x, y, w, h;
+    size_t tile_w, tile_h;
+    size_t layout;
+    size_t cols;
+    size_t ntiles;
+    struct pool *pool;
+    uint8_t *result;
+};
+
+/**
+ * This function converts GRAY_ROWS source rows to grayscale (pool task).
+ * @param ctx Job (struct tile_job)
+ * @param task Index of the block of rows
+ * @param worker Index of the worker
+ */
+static void gray_task(void *ctx, size_t task, size_t worker){
+    (void)worker;
+    const struct tile_job *job = ctx;
+    size_t r = task * GRAY_ROWS;
+    size_t n = (job->gray_rows - r < GRAY_ROWS) ? job->gray_rows - r : GRAY_ROWS;
+    grayscale(job->img + (job->gray_first - job->first_row + r) * job->width * 3, job->gray + r * job->width,
+              job->width, n, job->coeffs[0], job->coeffs[1], job->coeffs[2]);
+}
+
+/**
+ * This function computes one tile of the output window (pool task).
+ * @param ctx Job (struct tile_job)
+ * @param task Index of the tile, row-major
+ * @param worker Index of the worker
+ */
+static void tile_task(void *ctx, size_t task, size_t worker){
+    (void)worker;
+    const struct tile_job *job = ctx;
+    uint64_t t = trace_begin();
+    size_t tx = (task % job->cols) * job->tile_w;
+    size_t ty = (task / job->cols) * job->tile_h;
+    size_t tw = (job->w - tx < job->tile_w) ? job->w - tx : job->tile_w;
+    size_t th = (job->h - ty < job->tile_h) ? job->h - ty : job->tile_h;
+    // A tile of the tiled layout is a block of its own, otherwise it is a window of the output
+    uint8_t *out = job->result + ty * job->w + tx;
+    size_t stride = job->w;
+    if (job->layout){
+        out = job->result + layout_offset(job->layout, 1, task);
+        stride = tw;
+    }
+    if (job->filter != FILTER_BILINEAR){
+        interpolate_region_filter(job->gray, job->gray_first, job->width, job->height, job->scalFac, job->filter,
+                                  job->x + tx, job->y + ty, tw, th, stride, out);
+    }
+    else {
+        interpolate_tile(job->gray, job->gray_first, job->width, job->height, job->scalFac, job->x + tx,
+                         job->y + ty, tw, th, stride, out);
+    }
+    trace_end("Kachel", (long)task, t);
+}
+
+/**
+ * This function returns the offset in the output from which on the tiles
+ * task, task + 1, ... are stored: the first row of the tile row for
+ * row-major output, the tile itself for the tiled layout.
+ * @param job Job
+ * @param task Index of the tile
+ */
+static size_t tile_start(const struct tile_job *job, size_t task){
+    if (job->layout){
+        return layout_offset(job->layout, 1, task);
+    }
+    if (task >= job->ntiles){
+        return job->w * job->h;
+    }
+    return task / job->cols * job->tile_h * job->w;
+}
 
-    FILE *input_file = fopen("./input_data/smile3.ppm", "rb");
+/**
+ * This function writes one byte of every page of the output rows whose tiles
+ * pool_run puts into the deque of the worker (pool_each task), so the pages
+ * are allocated on the node of the worker that will write them.
+ * @param ctx Job (struct tile_job)
+ * @param task Index of the worker
+ * @param worker Index of the worker
+ */
+static void touch_task(void *ctx, size_t task, size_t worker){
+    (void)task;
+    const struct tile_job *job = ctx;
+    size_t first, end;
+    pool_block(job->pool, job->ntiles, worker, &first, &end);
+    // From the first tile of this block to the first tile of the next block
+    size_t off0 = tile_start(job, first);
+    size_t off1 = tile_start(job, job->ntiles);
+    if (worker + 1 < job->pool->nworkers){
+        pool_block(job->pool, job->ntiles, worker + 1, &first, &end);
+        off1 = tile_start(job, first);
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t off = off0; off < off1; off += page){
+        job->result[off] = 0;
+    }
+}
 
-    if (!input_file)
-    {
-        perror("Error by opening");
-        return 1;
+/**
+ * This function sets up the tiles of the output window.
+ * @param job Job
+ * @param pool Thread pool
+ * @param rect Window of the output image (x, y, w, h), NULL for the whole image
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param scalFac Scaling factor
+ * @param layout Edge length of the tiles of the tiled output layout, 0 for row-major output
+ * @param result Output image
+ */
+static void tile_setup(struct tile_job *job, struct pool *pool, const size_t *rect, size_t width, size_t height,
+                       size_t scalFac, size_t layout, uint8_t *result){
+    job->pool = pool;
+    job->width = width;
+    job->height = height;
+    job->scalFac = scalFac;
+    job->result = result;
+    job->x = 0, job->y = 0, job->w = width * scalFac, job->h = height * scalFac;
+    if (rect){
+        job->x = rect[0], job->y = rect[1], job->w = rect[2], job->h = rect[3];
     }
+    job->layout = layout;
+    job->tile_w = layout ? layout : TILE_WIDTH;
+    job->tile_h = layout ? layout : TILE_HEIGHT;
+    job->cols = (job->w + job->tile_w - 1) / job->tile_w;
+    job->ntiles = job->cols * ((job->h + job->tile_h - 1) / job->tile_h);
+}
 
-    FILE *output_file = fopen("output_img.pgm", "wb");
-    if (!output_file)
-    {
-        perror("Error by creating");
-        fclose(input_file);
-        return 1;
+void interpolate_tiles(struct pool *pool, const size_t *rect, size_t channels, const uint8_t *img, size_t first_row,
+                       size_t width, size_t height, const float *coeffs, size_t scalFac, int filter, size_t layout,
+                       uint8_t *tmp, uint8_t *result){
+    struct tile_job job = { .img = img, .first_row = first_row, .coeffs = coeffs, .filter = filter };
+    tile_setup(&job, pool, rect, width, height, scalFac, layout, result);
+    filter_source_rows(height, scalFac, filter, job.y, job.h, &job.gray_first, &job.gray_rows);
+    if (channels == 1){
+        job.gray = (uint8_t *)img + (job.gray_first - first_row) * width;
+    }
+    else {
+        job.gray = tmp;
+        pool_run(pool, (job.gray_rows + GRAY_ROWS - 1) / GRAY_ROWS, gray_task, &job);
     }
+    pool_run(pool, job.ntiles, tile_task, &job);
+}
 
-    uint8_t format[3];
-    size_t width, height, max_color;
-    size_t s = 10;
+void interpolate_tiles_touch(struct pool *pool, const size_t *rect, size_t width, size_t height, size_t scalFac,
+                             size_t layout, uint8_t *result){
+    struct tile_job job = { 0 };
+    tile_setup(&job, pool, rect, width, height, scalFac, layout, result);
+    pool_each(pool, touch_task, &job);
+}
 
-    fscanf(input_file, "%2s", format);
-    fscanf(input_file, "%zd %zd %zd", &width, &height, &max_color);
+#ifdef INTERPOLATE_VERIFY
+/*
+ * Verification harness, built from this file, the kernel registry and the modules of the tiles:
+ *     gcc -O2 -DINTERPOLATE_VERIFY interpolate.c filter.c kernel.c layout.c pool.c trace.c -o verify -lpthread -lm
+ *     ./verify [cases] [seed]
+ * Every kernel of kernels[] and every implementation below computes the
+ * complete output image, which has to match interpolate() (V0) byte for byte,
+ * or within the tolerance of its precision. Filters are compared with their
+ * scalar passes instead. The images of ./input_data and [cases] random images
+ * are checked.
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernel.h"
+
+// Largest factor of the random cases
+#define VERIFY_MAX_FACTOR 12
+// Largest width and height of the random cases
+#define VERIFY_MAX_SIZE 40
+// Range of the large factors above DDA_MIN_FACTOR and largest width and height of their cases
+#define VERIFY_LARGE_FACTOR 300
+#define VERIFY_LARGE_SIZE 8
+// Pi for the double precision reference of the filters
+#define VERIFY_PI 3.14159265358979323846
 
-    fgetc(input_file);
+/**
+ * A path under test that is no kernel of its own (windows, rows, tiles, ...)
+ * @param name Name in the report
+ * @param tolerance Largest allowed difference to the reference per pixel
+ * @param filter Filter of the reference: V0 for FILTER_BILINEAR, otherwise the scalar passes of
+ *        interpolate_region_filter() on the whole image, or the image itself for s = 1
+ * @param run Computes the interpolated image of the RGB image img
+ */
+struct verify_impl {
+    const char *name;
+    size_t tolerance;
+    int filter;
+    void (*run)(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result);
+};
+
+static void verify_region(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    uint8_t *tmp = malloc(width * height);
+    grayscale(img, tmp, width, height, 0, 0, 0);
+    interpolate_region(tmp, 0, width, height, s, 0, 0, width * s, height * s, result);
+    free(tmp);
+}
 
-    fprintf(output_file, "P2\n%lu %lu\n%d\n", s * width, s * height, 255);
+//The output is put together from up to four windows around a random point
+static void verify_roi(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    size_t ow = width * s, oh = height * s;
+    size_t sx = (size_t)rand() % ow, sy = (size_t)rand() % oh;
+    size_t xs[3] = {0, sx, ow}, ys[3] = {0, sy, oh};
+    uint8_t *tmp = malloc(width * height);
+    for (int a = 0; a < 2; a++){
+        for (int b = 0; b < 2; b++){
+            size_t x = xs[b], y = ys[a], w = xs[b + 1] - x, h = ys[a + 1] - y;
+            if (w == 0 || h == 0){
+                continue;
+            }
+            size_t first, rows;
+            interpolate_source_rows(height, s, y, h, &first, &rows);
+            uint8_t *win = malloc(w * h);
+            interpolate_roi(img + first * width * 3, first, width, height, 0, 0, 0, s, x, y, w, h, tmp, win);
+            for (size_t r = 0; r < h; r++){
+                memcpy(result + (y + r) * ow + x, win + r * w, w);
+            }
+            free(win);
+        }
+    }
+    free(tmp);
+}
 
-    unsigned char *arr_of_img = (uint8_t *)malloc(width * height * 3);
-    uint8_t *res_img_gray = (uint8_t *)malloc(width * height);
-    uint8_t *res_img = (uint8_t *)malloc((s * width) * (s * height));
+static void verify_rows(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    uint8_t *tmp = malloc(width * height);
+    grayscale(img, tmp, width, height, 0, 0, 0);
+    for (size_t i = 0; i < height; i++){
+        uint8_t *band = result + i * s * width * s;
+        interpolate_rows(tmp, 0, width, height, &s, 1, i, false, &band);
+    }
+    free(tmp);
+}
 
-    fread(arr_of_img, sizeof(uint8_t), width * height * 3, input_file);
+static void verify_region16(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    uint8_t *tmp = malloc(width * height);
+    uint16_t *gray = malloc(width * height * sizeof(uint16_t));
+    uint16_t *out = malloc(width * s * height * s * sizeof(uint16_t));
+    grayscale(img, tmp, width, height, 0, 0, 0);
+    for (size_t i = 0; i < width * height; i++){
+        gray[i] = tmp[i];
+    }
+    interpolate_region16(gray, 0, width, height, s, 0, 0, width * s, height * s, out);
+    for (size_t i = 0; i < width * s * height * s; i++){
+        result[i] = (out[i] > 255) ? 0 : (uint8_t)out[i];
+    }
+    free(out);
+    free(gray);
+    free(tmp);
+}
+
+//Every plane of the color output has to match V0 on that plane alone, without grayscale conversion
+static void verify_color_plane(const uint8_t *img, size_t width, size_t height, size_t s, size_t c, uint8_t *result){
+    uint8_t *planes = malloc(width * height * 3);
+    uint8_t *color = malloc(width * s * height * s * 3);
+    interpolate_color(img, 0, width, height, s, 0, 0, width * s, height * s, planes, color);
+    for (size_t i = 0; i < width * s * height * s; i++){
+        result[i] = color[i * 3 + c];
+    }
+    free(color);
+    free(planes);
+}
+
+static void verify_color_r(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_color_plane(img, width, height, s, 0, result);
+}
 
-    const uint8_t *img = (const uint8_t *)arr_of_img;
+static void verify_color_g(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_color_plane(img, width, height, s, 1, result);
+}
 
-    interpolate(arr_of_img, width, height, 0, 0, 0, s, res_img_gray, res_img);
+static void verify_color_b(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_color_plane(img, width, height, s, 2, result);
+}
 
-    for (size_t i = 0; i < (s * width) * (s * height); ++i)
-    {
-        fprintf(output_file, "%d ", res_img[i]);
+//The tiles of the thread pool, from the grayscale conversion on, with several workers
+static void verify_tiles(const uint8_t *img, size_t width, size_t height, size_t s, size_t workers, uint8_t *result){
+    static const float coeffs[3] = {0, 0, 0};
+    uint8_t *tmp = malloc(width * height);
+    struct pool pool;
+    if (pool_create(&pool, workers) == 0){
+        interpolate_tiles(&pool, NULL, 3, img, 0, width, height, coeffs, s, FILTER_BILINEAR, 0, tmp, result);
+        pool_destroy(&pool);
     }
+    free(tmp);
+}
 
-    fclose(input_file);
-    fclose(output_file);
+static void verify_tiles1(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_tiles(img, width, height, s, 1, result);
+}
 
-    free(arr_of_img);
-    free(res_img_gray);
-    free(res_img);
+static void verify_tiles3(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_tiles(img, width, height, s, 3, result);
+}
 
+static void verify_tiles7(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_tiles(img, width, height, s, 7, result);
+}
+
+static void verify_filter(const uint8_t *img, size_t width, size_t height, size_t s, int filter, bool scalar,
+                          uint8_t *result){
+    uint8_t *tmp = malloc(width * height);
+    grayscale(img, tmp, width, height, 0, 0, 0);
+    filter_scalar = scalar;
+    interpolate_region_filter(tmp, 0, width, height, s, filter, 0, 0, width * s, height * s, width * s, result);
+    filter_scalar = false;
+    free(tmp);
+}
+
+//Up to four windows around a random point, each one from the source rows it needs
+static void verify_filter_roi(const uint8_t *img, size_t width, size_t height, size_t s, int filter,
+                              uint8_t *result){
+    size_t ow = width * s, oh = height * s;
+    size_t sx = (size_t)rand() % ow, sy = (size_t)rand() % oh;
+    size_t xs[3] = {0, sx, ow}, ys[3] = {0, sy, oh};
+    uint8_t *tmp = malloc(width * height);
+    grayscale(img, tmp, width, height, 0, 0, 0);
+    for (int a = 0; a < 2; a++){
+        for (int b = 0; b < 2; b++){
+            size_t x = xs[b], y = ys[a], w = xs[b + 1] - x, h = ys[a + 1] - y;
+            if (w == 0 || h == 0){
+                continue;
+            }
+            size_t first, rows;
+            filter_source_rows(height, s, filter, y, h, &first, &rows);
+            interpolate_region_filter(tmp + first * width, first, width, height, s, filter, x, y, w, h, ow,
+                                      result + y * ow + x);
+        }
+    }
+    free(tmp);
+}
+
+static void verify_filter_tiles(const uint8_t *img, size_t width, size_t height, size_t s, int filter,
+                                uint8_t *result){
+    static const float coeffs[3] = {0, 0, 0};
+    uint8_t *tmp = malloc(width * height);
+    struct pool pool;
+    if (pool_create(&pool, 3) == 0){
+        interpolate_tiles(&pool, NULL, 3, img, 0, width, height, coeffs, s, filter, 0, tmp, result);
+        pool_destroy(&pool);
+    }
+    free(tmp);
+}
+
+static double verify_sinc(double t){
+    return (t == 0) ? 1 : sin(VERIFY_PI * t) / (VERIFY_PI * t);
+}
+
+//Weight of a source pixel at distance t, from the definitions of the filters and not from filter.c
+static double verify_kernel(int filter, double t){
+    t = fabs(t);
+    if (filter == FILTER_BICUBIC){
+        //Keys' cubic convolution with a = -0.5 (Catmull-Rom)
+        const double a = -0.5;
+        if (t < 1){
+            return (a + 2) * t * t * t - (a + 3) * t * t + 1;
+        }
+        if (t < 2){
+            return a * t * t * t - 5 * a * t * t + 8 * a * t - 4 * a;
+        }
+        return 0;
+    }
+    return (t < 3) ? verify_sinc(t) * verify_sinc(t / 3) : 0;
+}
+
+/**
+ * This function resamples one axis in double precision: output pixel o sits at
+ * source position o / s and blends the source pixels within the radius of the
+ * filter with normalized weights, pixels outside the image repeat the edge.
+ * @param src Source lines, n pixels each, stride apart, step between pixels
+ * @param out Output lines, n * s pixels each, stride apart, step between pixels
+ */
+static void verify_axis(int filter, size_t s, const double *src, size_t n, size_t lines, size_t src_stride,
+                        size_t src_step, double *out, size_t out_stride, size_t out_step){
+    long radius = (filter == FILTER_BICUBIC) ? 2 : 3;
+    for (size_t o = 0; o < n * s; o++){
+        double pos = (double)o / (double)s;
+        long base = (long)(o / s);
+        double weights[6];
+        long cols[6];
+        double norm = 0;
+        for (long k = 0; k < 2 * radius; k++){
+            long j = base - radius + 1 + k;
+            weights[k] = verify_kernel(filter, (double)j - pos);
+            norm += weights[k];
+            cols[k] = (j < 0) ? 0 : (j > (long)n - 1) ? (long)n - 1 : j;
+        }
+        for (size_t l = 0; l < lines; l++){
+            double sum = 0;
+            for (long k = 0; k < 2 * radius; k++){
+                sum += weights[k] * src[l * src_stride + (size_t)cols[k] * src_step];
+            }
+            out[l * out_stride + o * out_step] = sum / norm;
+        }
+    }
+}
+
+//Double precision reference of the fixed-point filter passes, they may differ by their rounding
+static void verify_filter_double(const uint8_t *img, size_t width, size_t height, size_t s, int filter,
+                                 uint8_t *result){
+    size_t ow = width * s, oh = height * s;
+    uint8_t *gray = malloc(width * height);
+    double *src = malloc(width * height * sizeof(double));
+    double *rows = malloc(ow * height * sizeof(double));
+    double *out = malloc(ow * oh * sizeof(double));
+    grayscale(img, gray, width, height, 0, 0, 0);
+    for (size_t i = 0; i < width * height; i++){
+        src[i] = gray[i];
+    }
+    verify_axis(filter, s, src, width, height, width, 1, rows, ow, 1);
+    verify_axis(filter, s, rows, height, ow, 1, ow, out, 1, ow);
+    for (size_t i = 0; i < ow * oh; i++){
+        double v = round(out[i]);
+        result[i] = (uint8_t)((v < 0) ? 0 : (v > 255) ? 255 : v);
+    }
+    free(out);
+    free(rows);
+    free(src);
+    free(gray);
+}
+
+static void verify_bicubic_double(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_double(img, width, height, s, FILTER_BICUBIC, result);
+}
+
+static void verify_bicubic_roi(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_roi(img, width, height, s, FILTER_BICUBIC, result);
+}
+
+static void verify_bicubic_tiles(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_tiles(img, width, height, s, FILTER_BICUBIC, result);
+}
+
+static void verify_lanczos_double(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_double(img, width, height, s, FILTER_LANCZOS, result);
+}
+
+static void verify_lanczos_roi(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_roi(img, width, height, s, FILTER_LANCZOS, result);
+}
+
+static void verify_lanczos_tiles(const uint8_t *img, size_t width, size_t height, size_t s, uint8_t *result){
+    verify_filter_tiles(img, width, height, s, FILTER_LANCZOS, result);
+}
+
+static const struct verify_impl verify_impls[] = {
+    {"region", 0, FILTER_BILINEAR, verify_region},
+    {"roi", 0, FILTER_BILINEAR, verify_roi},
+    {"rows", 0, FILTER_BILINEAR, verify_rows},
+    {"region16", 0, FILTER_BILINEAR, verify_region16},
+    {"tiles-1", 0, FILTER_BILINEAR, verify_tiles1},
+    {"tiles-3", 0, FILTER_BILINEAR, verify_tiles3},
+    {"tiles-7", 0, FILTER_BILINEAR, verify_tiles7},
+    {"color-r", 0, FILTER_BILINEAR, verify_color_r},
+    {"color-g", 0, FILTER_BILINEAR, verify_color_g},
+    {"color-b", 0, FILTER_BILINEAR, verify_color_b},
+    {"bicubic-double", 1, FILTER_BICUBIC, verify_bicubic_double},
+    {"bicubic-roi", 0, FILTER_BICUBIC, verify_bicubic_roi},
+    {"bicubic-tiles", 0, FILTER_BICUBIC, verify_bicubic_tiles},
+    {"lanczos-double", 1, FILTER_LANCZOS, verify_lanczos_double},
+    {"lanczos-roi", 0, FILTER_LANCZOS, verify_lanczos_roi},
+    {"lanczos-tiles", 0, FILTER_LANCZOS, verify_lanczos_tiles},
+};
+
+/**
+ * This function computes the reference of a check: V0 of the grayscale image
+ * or of one color plane, for a filter its scalar passes (the image itself for
+ * s = 1).
+ * @param filter Filter of the check
+ * @param c Color plane (0 .. 2), (size_t)-1 for the grayscale image
+ * @param tmp Buffer for the grayscale image
+ * @param expected Reference
+ */
+static void verify_reference(const uint8_t *img, size_t width, size_t height, size_t s, int filter, size_t c,
+                             uint8_t *tmp, uint8_t *expected){
+    if (filter != FILTER_BILINEAR && s == 1){
+        grayscale(img, expected, width, height, 0, 0, 0);
+    }
+    else if (filter != FILTER_BILINEAR){
+        verify_filter(img, width, height, s, filter, true, expected);
+    }
+    else if (c == (size_t)-1){
+        interpolate(img, width, height, 0, 0, 0, s, tmp, expected);
+    }
+    else {
+        for (size_t i = 0; i < width * height; i++){
+            tmp[i] = img[i * 3 + c];
+        }
+        interpolate_gray(tmp, width, height, s, expected);
+    }
+}
+
+/**
+ * This function compares a result with its reference.
+ * @param name Name of the implementation in the report
+ * @param tolerance Largest allowed difference per pixel
+ * @return 1 if a pixel differs by more than tolerance, 0 otherwise
+ */
+static size_t verify_compare(const char *name, size_t tolerance, const char *label, size_t width, size_t height,
+                             size_t s, const uint8_t *result, const uint8_t *expected){
+    for (size_t i = 0; i < width * s * height * s; i++){
+        size_t diff = (result[i] > expected[i]) ? result[i] - expected[i] : expected[i] - result[i];
+        if (diff > tolerance){
+            printf("FAIL %-8s %s %lux%lu s=%lu: pixel (%lu, %lu) is %d, expected %d\n", name, label,
+                   width, height, s, i % (width * s), i / (width * s), result[i], expected[i]);
+            return 1;
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * This function checks all kernels of the registry that support the factor on
+ * this CPU and all other implementations for one image and factor.
+ * @param label Name of the image in the report
+ * @return Number of failed implementations
+ */
+static size_t verify_case(const char *label, const uint8_t *img, size_t width, size_t height, size_t s){
+    size_t len = width * s * height * s;
+    uint8_t *tmp = malloc(width * height);
+    uint8_t *expected = malloc(len);
+    uint8_t *result = malloc(len);
+    size_t failures = 0;
+
+    //Every kernel of the registry on the grayscale image, the tolerance follows from its precision
+    for (size_t k = 0; k < nkernels; k++){
+        const struct kernel *kernel = &kernels[k];
+        if (!kernel_supports(kernel, s)){
+            continue;
+        }
+        verify_reference(img, width, height, s, kernel->filter, (size_t)-1, tmp, expected);
+        memset(result, 0, len);
+        grayscale(img, tmp, width, height, 0, 0, 0);
+        kernel->gray(tmp, width, height, s, result);
+        size_t tolerance = (kernel->precision == KERNEL_FAST) ? KERNEL_FAST_DIFF : 0;
+        failures += verify_compare(kernel->name, tolerance, label, width, height, s, result, expected);
+    }
+
+    for (size_t k = 0; k < sizeof(verify_impls) / sizeof(verify_impls[0]); k++){
+        const struct verify_impl *impl = &verify_impls[k];
+        //The color planes are compared with V0 on a gray image made of that plane
+        size_t c = (size_t)-1;
+        if (strncmp(impl->name, "color-", 6) == 0){
+            c = (impl->name[6] == 'r') ? 0 : (impl->name[6] == 'g') ? 1 : 2;
+        }
+        verify_reference(img, width, height, s, impl->filter, c, tmp, expected);
+        memset(result, 0, len);
+        impl->run(img, width, height, s, result);
+        failures += verify_compare(impl->name, impl->tolerance, label, width, height, s, result, expected);
+    }
+
+    free(result);
+    free(expected);
+    free(tmp);
+    return failures;
+}
+
+/**
+ * This function reads a binary PPM image (P6, maxval 255).
+ * @return Pixels (NULL if the file is no such image)
+ */
+static uint8_t *verify_load(const char *path, size_t *width, size_t *height){
+    FILE *f = fopen(path, "rb");
+    if (!f){
+        return NULL;
+    }
+    size_t values[3];
+    int ch = 0;
+    int ok = fgetc(f) == 'P' && fgetc(f) == '6';
+    for (int n = 0; ok && n < 3; n++){
+        //Whitespace and comments before every number
+        while ((ch = fgetc(f)) == '#' || (ch != EOF && isspace(ch))){
+            if (ch == '#'){
+                while ((ch = fgetc(f)) != EOF && ch != '\n');
+            }
+        }
+        ungetc(ch, f);
+        ok = fscanf(f, "%zu", &values[n]) == 1;
+    }
+    uint8_t *img = NULL;
+    if (ok && values[2] == 255 && fgetc(f) != EOF && values[0] < 65536 && values[1] < 65536){
+        *width = values[0];
+        *height = values[1];
+        img = malloc(*width * *height * 3);
+        if (img && fread(img, 1, *width * *height * 3, f) != *width * *height * 3){
+            free(img);
+            img = NULL;
+        }
+    }
+    fclose(f);
+    return img;
+}
+
+int main(int argc, char *argv[]){
+    size_t cases = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200;
+    unsigned seed = (argc > 2) ? (unsigned)strtoul(argv[2], NULL, 10) : 1;
+    srand(seed);
+    size_t checks = 0, failures = 0;
+
+    //1. The sample images, small factors and one that needs the vector path of V1 several times
+    static const size_t factors[] = {1, 2, 3, 4, 5, 8, 13};
+    DIR *dir = opendir("./input_data");
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL){
+        char path[512];
+        snprintf(path, sizeof(path), "./input_data/%s", entry->d_name);
+        size_t width, height;
+        uint8_t *img = verify_load(path, &width, &height);
+        //Images smaller than one quad are no valid input for V0
+        if (img && width >= 2 && height >= 2){
+            for (size_t k = 0; k < sizeof(factors) / sizeof(factors[0]); k++){
+                //Keep the large sample images fast
+                if (width * height * factors[k] * factors[k] > (1 << 24)){
+                    continue;
+                }
+                failures += verify_case(entry->d_name, img, width, height, factors[k]);
+                checks++;
+            }
+        }
+        free(img);
+    }
+    if (dir){
+        closedir(dir);
+    }
+
+    //2. Random images, sizes and factors
+    for (size_t n = 0; n < cases; n++){
+        size_t width = 2 + (size_t)rand() % (VERIFY_MAX_SIZE - 1);
+        size_t height = 2 + (size_t)rand() % (VERIFY_MAX_SIZE - 1);
+        size_t s = 1 + (size_t)rand() % VERIFY_MAX_FACTOR;
+        uint8_t *img = malloc(width * height * 3);
+        for (size_t i = 0; i < width * height * 3; i++){
+            img[i] = (uint8_t)rand();
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "random#%lu", n);
+        failures += verify_case(label, img, width, height, s);
+        checks++;
+        free(img);
+    }
+
+    //3. Large factors, whose quads are evaluated by forward differencing
+    for (size_t n = 0; n < cases / 4; n++){
+        size_t width = 2 + (size_t)rand() % (VERIFY_LARGE_SIZE - 1);
+        size_t height = 2 + (size_t)rand() % (VERIFY_LARGE_SIZE - 1);
+        size_t s = DDA_MIN_FACTOR + (size_t)rand() % VERIFY_LARGE_FACTOR;
+        uint8_t *img = malloc(width * height * 3);
+        for (size_t i = 0; i < width * height * 3; i++){
+            img[i] = (uint8_t)rand();
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "large#%lu", n);
+        failures += verify_case(label, img, width, height, s);
+        checks++;
+        free(img);
+    }
+
+    size_t nimpls = nkernels + sizeof(verify_impls) / sizeof(verify_impls[0]);
+    printf("%lu cases x %lu implementations, %lu failures (seed %u)\n", checks, nimpls, failures, seed);
+    return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+#include "interpolate.h"
+#include "kernel.h"
+
+/**
+ * This function is interpolate_region_fast() for the whole image.
+ */
+static void interpolate_gray_fast(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor,
+                                  uint8_t *result) {
+    interpolate_region_fast(tmp, 0, width, height, scale_factor, 0, 0, width * scale_factor, height * scale_factor,
+                            result);
+}
+
+/**
+ * This function is interpolate_region_filter() with the bicubic filter for the whole image.
+ */
+static void interpolate_gray_bicubic(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor,
+                                     uint8_t *result) {
+    size_t w = width * scale_factor;
+    interpolate_region_filter(tmp, 0, width, height, scale_factor, FILTER_BICUBIC, 0, 0, w, height * scale_factor, w,
+                              result);
+}
+
+/**
+ * This function is interpolate_region_filter() with the Lanczos filter for the whole image.
+ */
+static void interpolate_gray_lanczos(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor,
+                                     uint8_t *result) {
+    size_t w = width * scale_factor;
+    interpolate_region_filter(tmp, 0, width, height, scale_factor, FILTER_LANCZOS, 0, 0, w, height * scale_factor, w,
+                              result);
+}
+
+const struct kernel kernels[] = {
+    { "reference", "Hauptimplementierung", interpolate_gray, interpolate_quads, 0, 0, SIZE_MAX, KERNEL_EXACT,
+      FILTER_BILINEAR },
+    // The weights of the SSE kernel are 32 bit products of up to 255 * s^2, so s is at most sqrt(2^31 / 255)
+    { "sse", "SSE, vier Gewichte je Befehl", interpolate_gray_V1, interpolate_quads_V1, KERNEL_SSE2, 0, 2901,
+      KERNEL_EXACT, FILTER_BILINEAR },
+    { "dda", "Vorwärtsdifferenzen, v.a. für große Faktoren", interpolate_gray_V2, NULL, 0, KERNEL_AVX2, SIZE_MAX,
+      KERNEL_EXACT, FILTER_BILINEAR },
+    { "fast", "7 Bit Gewichte (--precision fast)", interpolate_gray_fast, NULL, 0, KERNEL_SSSE3, SIZE_MAX,
+      KERNEL_FAST, FILTER_BILINEAR },
+    { "bicubic", "Catmull-Rom, 4x4 Taps (--filter bicubic)", interpolate_gray_bicubic, NULL, 0, KERNEL_AVX2,
+      SIZE_MAX, KERNEL_FILTER, FILTER_BICUBIC },
+    { "lanczos", "Lanczos-3, 6x6 Taps (--filter lanczos)", interpolate_gray_lanczos, NULL, 0, KERNEL_AVX2,
+      SIZE_MAX, KERNEL_FILTER, FILTER_LANCZOS },
+};
+const size_t nkernels = sizeof(kernels) / sizeof(kernels[0]);
+
+/**
+ * This function checks whether the CPU has a set of features.
+ * @param features CPU features (KERNEL_*)
+ */
+static bool cpu_has(unsigned features) {
+    return (!(features & KERNEL_SSE2) || __builtin_cpu_supports("sse2")) &&
+           (!(features & KERNEL_SSSE3) || __builtin_cpu_supports("ssse3")) &&
+           (!(features & KERNEL_AVX2) || __builtin_cpu_supports("avx2"));
+}
+
+/**
+ * This function writes the names of a set of CPU features.
+ * @param buf Buffer
+ * @param len Length of the buffer
+ * @param features CPU features (KERNEL_*)
+ */
+static void feature_names(char *buf, size_t len, unsigned features) {
+    snprintf(buf, len, "%s%s%s%s", features == 0 ? "-" : "", (features & KERNEL_SSE2) ? "SSE2 " : "",
+             (features & KERNEL_SSSE3) ? "SSSE3 " : "", (features & KERNEL_AVX2) ? "AVX2 " : "");
+    size_t end = strlen(buf);
+    if (end > 0 && buf[end - 1] == ' ') {
+        buf[end - 1] = '\0';
+    }
+}
+
+int kernel_find(const char *name) {
+    char *end;
+    unsigned long version = strtoul(name, &end, 10);
+    if (end != name && *end == '\0') {
+        return (version < nkernels) ? (int)version : -1;
+    }
+    for (size_t k = 0; k < nkernels; k++) {
+        if (strcmp(name, kernels[k].name) == 0) {
+            return (int)k;
+        }
+    }
+    return -1;
+}
+
+bool kernel_supports(const struct kernel *kernel, size_t scale_factor) {
+    return scale_factor <= kernel->max_factor && cpu_has(kernel->features);
+}
+
+void kernel_list(FILE *out) {
+    static const char *const filters[] = { "bilinear", "bicubic", "lanczos" };
+    fprintf(out, "%-2s %-10s %-8s %-7s %-7s %-9s %-11s %-9s %s\n", "V", "Name", "Filter", "Braucht", "Nutzt",
+            "Faktoren", "Genauigkeit", "CPU", "Beschreibung");
+    for (size_t k = 0; k < nkernels; k++) {
+        const struct kernel *kernel = &kernels[k];
+        char features[32];
+        char simd[32];
+        char factors[32];
+        feature_names(features, sizeof(features), kernel->features);
+        feature_names(simd, sizeof(simd), kernel->simd);
+        if (kernel->max_factor == SIZE_MAX) {
+            snprintf(factors, sizeof(factors), "alle");
+        }
+        else {
+            snprintf(factors, sizeof(factors), "1-%lu", kernel->max_factor);
+        }
+        // Filter kernels are exact with respect to the scalar passes of their filter, not to V0
+        const char *precision = kernel->precision == KERNEL_EXACT  ? "exakt"
+                                : kernel->precision == KERNEL_FAST ? "fast"
+                                                                   : filters[kernel->filter];
+        const char *cpu = !cpu_has(kernel->features) ? "nein" : cpu_has(kernel->simd) ? "ja" : "Fallback";
+        fprintf(out, "%-2lu %-10s %-8s %-7s %-7s %-9s %-11s %-9s %s\n", k, kernel->name, filters[kernel->filter],
+                features, simd, factors, precision, cpu, kernel->description);
+    }
+}
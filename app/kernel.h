@@ -0,0 +1,66 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// CPU features of the kernels (bit mask)
+#define KERNEL_SSE2 1
+#define KERNEL_SSSE3 2
+#define KERNEL_AVX2 4
+
+// Precision of the kernels
+#define KERNEL_EXACT 0  // Identical to V0
+#define KERNEL_FAST 1   // At most KERNEL_FAST_DIFF gray levels from V0 (--precision fast)
+#define KERNEL_FILTER 2 // Another filter than bilinear, identical to the scalar passes of that filter (--filter)
+#define KERNEL_FAST_DIFF 2
+
+/**
+ * Implementation of the interpolation of a whole grayscale image (-V)
+ * @param name Name for -V and --list-kernels
+ * @param description Description for --list-kernels
+ * @param gray Interpolation of a grayscale image
+ * @param quads Interpolation of the quads after interpolate_place (--counters), NULL if the kernel has no placement step
+ * @param features CPU features the kernel needs
+ * @param simd CPU features the kernel uses if they are available (with a fallback otherwise)
+ * @param max_factor Largest supported scaling factor
+ * @param precision KERNEL_EXACT, KERNEL_FAST or KERNEL_FILTER
+ * @param filter Resampling filter (FILTER_*), only bilinear kernels give the output of V0
+ */
+struct kernel {
+    const char *name;
+    const char *description;
+    void (*gray)(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result);
+    void (*quads)(const uint8_t *tmp, size_t width, size_t height, size_t scale_factor, uint8_t *result);
+    unsigned features;
+    unsigned simd;
+    size_t max_factor;
+    int precision;
+    int filter;
+};
+
+// All kernels, the index is the version of -V
+extern const struct kernel kernels[];
+extern const size_t nkernels;
+
+/**
+ * This function looks up a kernel by its version or its name.
+ * @param name Version (e.g. "2") or name (e.g. "dda")
+ * @return Version of the kernel, -1 if there is none
+ */
+int kernel_find(const char *name);
+
+/**
+ * This function checks whether a kernel runs on this CPU with a scaling factor.
+ * @param kernel Kernel
+ * @param scale_factor Scaling factor
+ * @return The CPU has the features of the kernel and the factor is supported
+ */
+bool kernel_supports(const struct kernel *kernel, size_t scale_factor);
+
+/**
+ * This function prints all kernels with their version, name, CPU features,
+ * supported scaling factors and precision, and whether the CPU has the
+ * features (--list-kernels).
+ * @param out Output
+ */
+void kernel_list(FILE *out);
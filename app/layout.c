@@ -0,0 +1,54 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "layout.h"
+
+size_t layout_size(size_t width, size_t height, size_t tile){
+    size_t count = ((width + tile - 1) / tile) * ((height + tile - 1) / tile);
+    size_t len = sizeof(struct layout_header) + count * sizeof(struct layout_entry);
+    return (len + LAYOUT_ALIGN - 1) / LAYOUT_ALIGN * LAYOUT_ALIGN;
+}
+
+size_t layout_offset(size_t tile, size_t channels, size_t index){
+    //Every tile has a slot of the size of a full tile, padded to the next page
+    size_t slot = (tile * tile * channels + LAYOUT_ALIGN - 1) / LAYOUT_ALIGN * LAYOUT_ALIGN;
+    return index * slot;
+}
+
+size_t layout_data_size(size_t width, size_t height, size_t tile, size_t channels){
+    size_t count = ((width + tile - 1) / tile) * ((height + tile - 1) / tile);
+    return layout_offset(tile, channels, count);
+}
+
+size_t layout_header(uint8_t *buf, size_t width, size_t height, size_t tile, size_t channels, size_t maxval){
+    if (width > UINT32_MAX || height > UINT32_MAX || tile > UINT32_MAX){
+        return 0;
+    }
+    size_t len = layout_size(width, height, tile);
+    memset(buf, 0, len);
+
+    struct layout_header header;
+    memcpy(header.magic, LAYOUT_MAGIC, sizeof(header.magic));
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.tile_width = (uint32_t)tile;
+    header.tile_height = (uint32_t)tile;
+    header.cols = (uint32_t)((width + tile - 1) / tile);
+    header.rows = (uint32_t)((height + tile - 1) / tile);
+    header.channels = (uint32_t)channels;
+    header.maxval = (uint32_t)maxval;
+    header.data = len;
+    header.count = (uint64_t)header.cols * header.rows;
+    memcpy(buf, &header, sizeof(header));
+
+    for (size_t index = 0; index < header.count; index++){
+        size_t tx = (index % header.cols) * tile;
+        size_t ty = (index / header.cols) * tile;
+        struct layout_entry entry;
+        entry.offset = len + layout_offset(tile, channels, index);
+        entry.width = (uint32_t)((width - tx < tile) ? width - tx : tile);
+        entry.height = (uint32_t)((height - ty < tile) ? height - ty : tile);
+        memcpy(buf + sizeof(header) + index * sizeof(entry), &entry, sizeof(entry));
+    }
+    return len;
+}
@@ -0,0 +1,92 @@
+#include <stddef.h>
+#include <stdint.h>
+
+// Magic number of a tiled output file (--layout tiles)
+#define LAYOUT_MAGIC "PNMTILE1"
+// Every tile starts at a multiple of LAYOUT_ALIGN, so a single tile can be mapped without copying
+#define LAYOUT_ALIGN 4096
+
+/**
+ * Header at the start of a tiled output file. All numbers are stored in the
+ * byte order of the host (little-endian on x86).
+ * @param magic LAYOUT_MAGIC (without terminating null byte)
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param tile_width Width of the tiles (the last tile column may be narrower)
+ * @param tile_height Height of the tiles (the last tile row may be lower)
+ * @param cols Number of tile columns
+ * @param rows Number of tile rows
+ * @param channels Samples per pixel (1 byte each)
+ * @param maxval Maximum sample value
+ * @param data Offset of the first tile in the file
+ * @param count Number of tiles, the index of cols * rows entries follows the header
+ */
+struct layout_header {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t channels;
+    uint32_t maxval;
+    uint64_t data;
+    uint64_t count;
+};
+
+/**
+ * Entry of the tile index, the tiles are listed row by row
+ * @param offset Offset of the tile in the file
+ * @param width Width of the tile
+ * @param height Height of the tile
+ */
+struct layout_entry {
+    uint64_t offset;
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * This function returns the size of the header and the index of a tiled
+ * image, rounded up to LAYOUT_ALIGN. The tile data starts at this offset.
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param tile Edge length of the tiles
+ */
+size_t layout_size(size_t width, size_t height, size_t tile);
+
+/**
+ * This function returns the offset of a tile relative to the start of the
+ * tile data. Every tile is stored row by row (tiles in the last column or
+ * row are trimmed to the image) at the start of a slot of
+ * tile * tile * channels bytes rounded up to LAYOUT_ALIGN, the rest of the
+ * slot is zero. The slots follow each other row by row.
+ * @param tile Edge length of the tiles
+ * @param channels Samples per pixel
+ * @param index Index of the tile, row-major
+ */
+size_t layout_offset(size_t tile, size_t channels, size_t index);
+
+/**
+ * This function returns the size of the tile data, one slot per tile.
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param tile Edge length of the tiles
+ * @param channels Samples per pixel
+ */
+size_t layout_data_size(size_t width, size_t height, size_t tile, size_t channels);
+
+/**
+ * This function writes the header and the index of a tiled image, padded
+ * with zeros to layout_size() bytes.
+ * @param buf Buffer of layout_size() bytes
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param tile Edge length of the tiles
+ * @param channels Samples per pixel
+ * @param maxval Maximum sample value
+ * @return Length of the header in bytes (layout_size()), 0 if the image or the
+ *         tiles are too large for the 32 bit fields of the header
+ */
+size_t layout_header(uint8_t *buf, size_t width, size_t height, size_t tile, size_t channels, size_t maxval);
@@ -11,9 +11,38 @@
 #include <ctype.h>
 #include <regex.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <limits.h>
 #include "interpolate.h"
+#include "pnm.h"
+#include "grayscale.h"
+#include "pyramid.h"
+#include "stream.h"
+#include "perf.h"
+#include "trace.h"
+#include "pool.h"
+#include "numa.h"
+#include "serve.h"
+#include "hash.h"
+#include "cache.h"
+#include "update.h"
+#include "frames.h"
+#include "filter.h"
+#include "layout.h"
+#include "plan.h"
+#include "tune.h"
+#include "kernel.h"
 
-const int VERSIONS = 1;
+// Maximum number of scaling factors that can be passed with -f
+#define MAX_FACTORS 16
+
+// Stages of the counter report (--counters)
+#define STAGE_READ 0
+#define STAGE_GRAY 1
+#define STAGE_PLACE 2
+#define STAGE_INTERP 3
+#define STAGE_WRITE 4
+#define STAGES 5
 
 const char *usage_msg = "Usage: %s <Eingabedatei> [options]\n"
 "   -o S            Ausgabedatei\n"
@@ -22,15 +51,37 @@ const char *usage_msg = "Usage: %s <Eingabedatei> [options]\n"
 
 const char *help_msg =
 "Positional arguments:\n"
-"  <Dateiname>      Eingabedatei\n"
+"  <Dateiname>      Eingabedatei im Format P6, P3, P5 oder P2 mit 8 oder 16 Bit (- für stdin)\n"
 "Optional arguments:\n"
-"  -V N             Welche Implementierung ausgeführt werden soll (default: N = 0 "
-"(Hauptimplementierung))\n"
+"  -V N|Name|auto   Welche Implementierung ausgeführt werden soll, Nummer oder Name aus --list-kernels "
+"(default: auto = schnellste laut --tune-Profil, ohne Profil 0), mit -B auch all: alle Implementierungen messen\n"
+"  --list-kernels   Alle Implementierungen mit CPU-Features, Faktoren und Genauigkeit auflisten\n"
 "  -B N             Messung der Laufzeit. Optionales Argument gibt die "
 "Wiederholungen an. (default: N = 1)\n"
-"  -o <Dateiname>   Ausgabedatei: S\n"
+"  -o <Dateiname>   Ausgabedatei: S (- für stdout)\n"
 "  --coeffs a b c   Koeffizienten der Graustufenkonvertierung (a,b,c) Floating Point Zahlen\n"
-"  -f N             Skalierungsfaktor\n"
+"  -f N[,N...]      Skalierungsfaktor, bei mehreren Faktoren entsteht je eine Ausgabedatei S_N\n"
+"  --roi x,y,w,h    Nur das Fenster (x,y,w,h) des Ausgabebildes berechnen (Ausgabekoordinaten)\n"
+"  --pyramid <Dir>  Kacheln aller Skalierungsfaktoren in den Kachel-Cache <Dir> schreiben\n"
+"  --tile N         Kantenlänge der Kacheln für --pyramid und --layout tiles (default: N = 256)\n"
+"  --layout L       rows (default) oder tiles: Ausgabe S.tiles als zusammenhängende Kacheln mit Index-Header\n"
+"  -m | --mmap      Ausgabedatei per mmap direkt beschreiben (kein Puffer, keine Kopie)\n"
+"  -a | --ascii     Ausgabedatei als ASCII-Bild (P2, P3) statt binär (P5, P6) schreiben\n"
+"  --color          Farbbild (P6) statt Graustufenbild skalieren, Ausgabedatei S.ppm\n"
+"  --precision P    exact (default) oder fast: schnellere Vorschau mit höchstens 2 Graustufen Abweichung\n"
+"  --filter F       bilinear (default), bicubic oder lanczos: Interpolationsfilter, bicubic und lanczos mit AVX2\n"
+"  --trace <Datei>  Zeitleiste aller Phasen und Bänder/Kacheln im Chrome trace_event Format schreiben\n"
+"  --counters       Wie -B, zusätzlich Hardware-Zähler (Zyklen, IPC, Cache-, TLB- und Branch-Misses) pro Phase\n"
+"  -j | --threads N Anzahl der Threads, die Kacheln werden per Work-Stealing verteilt (default: N = 1)\n"
+"  --numa M         off (default), cores oder nodes: Threads auf CPUs bzw. NUMA-Knoten pinnen, Ausgabe per First Touch verteilen\n"
+"  --serve <Socket> Daemon: Jobs (in=, out=, f=, coeffs=, V=) zeilenweise über einen Unix-Socket annehmen\n"
+"  --cache <Dir>    Ergebnisse unter einem Hash von Bilddaten und Parametern in <Dir> ablegen und wiederverwenden\n"
+"  --update <Datei> Vorhandene Ausgabedatei nur dort neu berechnen, wo sich das Bild gegenüber <Datei> geändert hat\n"
+"  --dirty x,y,w,h  Geänderter Bereich des Eingabebildes für das Aktualisieren der Ausgabedatei (mehrfach möglich)\n"
+"  --frames         Eingabe ist ein Strom aneinandergehängter P6/P5-Frames (z.B. ffmpeg image2pipe), Ausgabe als P5-Strom\n"
+"  --tune           Implementierungen, Threads und Bandhöhen auf dieser Maschine messen und als Profil für -V auto speichern\n"
+"  --profile <Datei> Profil für --tune und -V auto (default: ~/" TUNE_PROFILE ")\n"
+"  --max-memory N   Speicherbudget in Bytes (Suffix K, M oder G): Ausgabepuffer oder Streaming mit passender Bandhöhe wählen\n"
 "  -h | --help      Eine Beschreibung aller Optionen des Programms. (das hier)\n";
 
 /**
@@ -69,59 +120,423 @@ void is_digit(char *str, const char *progname) {
 }
 
 /**
- * This function takes a file stream as one of it's params and "jumps" all whitespace characters
- * until the file position is at a non whitespace char.
- * @param stream file stream to be searched
- * @param progname name of the progname
-*/
-void jumpWhitespace(FILE *stream, const char *progname) {
-    int a;
-    while (isspace(a = fgetc(stream)) != 0);
-    fseek(stream, -1, SEEK_CUR);
+ * Pinning of the workers (--numa)
+ * @param topo Topology
+ * @param mode NUMA_CORES or NUMA_NODES
+ * @param place Placement per worker
+ * @param failed Number of workers that could not be pinned
+ */
+struct numa_job {
+    const struct numa_topology *topo;
+    int mode;
+    struct numa_place place[POOL_MAX_WORKERS];
+    int failed;
+};
 
-    // Check for '#'
-    if (a == 35) {
-        while (a != '\n') {
-            a = fgetc(stream);
-        }
-        jumpWhitespace(stream, progname);
+/**
+ * This function pins a worker (pool_each task).
+ * @param ctx Job (struct numa_job)
+ * @param task Index of the worker
+ * @param worker Index of the worker
+ */
+static void pin_task(void *ctx, size_t task, size_t worker) {
+    (void)task;
+    struct numa_job *job = ctx;
+    if (numa_pin(job->topo, job->mode, worker, &job->place[worker]) != 0) {
+        __atomic_fetch_add(&job->failed, 1, __ATOMIC_RELAXED);
     }
 }
 
 /**
- * @brief This is the starting point of the program.
- * @param argc argument count
- * @param argv[] array of arguments
+ * This function opens the hardware counters of a worker (pool_each task).
+ * Worker 0 is the calling thread, whose counters are already open.
+ * @param ctx Counters (struct perf_counters)
+ * @param task Index of the worker
+ * @param worker Index of the worker
  */
-int main(int argc, char *argv[]) {
-    const char *progname = argv[0];
+static void perf_task(void *ctx, size_t task, size_t worker) {
+    (void)task;
+    if (worker > 0) {
+        perf_open_thread(ctx, worker);
+    }
+}
 
-    // If the argument count is one, there's no argument passed since the name of
-    // the program itself is argument one.
-    if (argc == 1) {
-        print_usage(progname);
-        // Prettier for return 1 alias failure
-        return EXIT_FAILURE;
+/**
+ * This function calls the selected implementation once. Grayscale inputs skip
+ * the conversion and are interpolated directly, color output interpolates the
+ * three color planes.
+ * @param impl Version of the kernel (ignored for a window and color output)
+ * @param color Interpolate the color planes instead of the grayscale image
+ * @param fast Use the fast kernel with quantized weights (grayscale output only)
+ * @param filter Resampling filter (FILTER_*), bicubic and Lanczos for grayscale output only
+ * @param layout Edge length of the tiles of the tiled output layout (needs the pool), 0 for row-major output
+ * @param rect Window of the output image (x, y, w, h), NULL for the whole image
+ * @param channels Samples per pixel of the input (1 or 3)
+ * @param img Source rows that were read
+ * @param first_row Index of the first source row in img
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param coeffs Coefficients for the grayscale conversion
+ * @param scalFac Scaling factor
+ * @param tmp Buffer for the grayscale rows (color planes for color output)
+ * @param result Output image
+ * @param pc Counters for the stages, NULL if they are not measured
+ * @param stages Stages of the counter report (STAGES entries)
+ * @param pool Thread pool for the grayscale output, NULL for a single thread
+ */
+static void run_interpolation(size_t impl, bool color, bool fast, int filter, size_t layout, const size_t *rect,
+                              size_t channels, const uint8_t *img, size_t first_row, size_t width, size_t height,
+                              const float *coeffs, size_t scalFac, uint8_t *tmp, uint8_t *result,
+                              const struct perf_counters *pc, struct perf_stage *stages, struct pool *pool) {
+    // The whole image is counted in separate steps: grayscale, placement and quads
+    if (pc && !pool && !color && !fast && filter == FILTER_BILINEAR && !rect) {
+        const uint8_t *gray = img;
+        if (channels != 1) {
+            perf_begin(pc, &stages[STAGE_GRAY]);
+            grayscale(img, tmp, width, height, coeffs[0], coeffs[1], coeffs[2]);
+            perf_end(pc, &stages[STAGE_GRAY]);
+            gray = tmp;
+        }
+        // Kernels without quads compute every pixel in one pass, there is no placement step
+        const struct kernel *kernel = &kernels[impl];
+        if (kernel->quads) {
+            perf_begin(pc, &stages[STAGE_PLACE]);
+            interpolate_place(gray, width, height, scalFac, result);
+            perf_end(pc, &stages[STAGE_PLACE]);
+        }
+        perf_begin(pc, &stages[STAGE_INTERP]);
+        if (kernel->quads) {
+            kernel->quads(gray, width, height, scalFac, result);
+        }
+        else {
+            kernel->gray(gray, width, height, scalFac, result);
+        }
+        perf_end(pc, &stages[STAGE_INTERP]);
+        return;
+    }
+    // The other modes interleave these steps and are counted as a whole
+    if (pc) {
+        perf_begin(pc, &stages[STAGE_INTERP]);
+        run_interpolation(impl, color, fast, filter, layout, rect, channels, img, first_row, width, height, coeffs,
+                          scalFac, tmp, result, NULL, NULL, pool);
+        perf_end(pc, &stages[STAGE_INTERP]);
+        return;
+    }
+    if (pool) {
+        interpolate_tiles(pool, rect, channels, img, first_row, width, height, coeffs, scalFac, filter, layout, tmp, result);
+        return;
+    }
+    if (color) {
+        if (rect) {
+            interpolate_color(img, first_row, width, height, scalFac, rect[0], rect[1], rect[2], rect[3], tmp, result);
+        }
+        else {
+            interpolate_color(img, 0, width, height, scalFac, 0, 0, width * scalFac, height * scalFac, tmp, result);
+        }
+        return;
+    }
+    if (fast || filter != FILTER_BILINEAR) {
+        size_t x = 0, y = 0, w = width * scalFac, h = height * scalFac;
+        if (rect) {
+            x = rect[0], y = rect[1], w = rect[2], h = rect[3];
+        }
+        // Only the rows the window depends on are converted to grayscale
+        size_t first, rows;
+        filter_source_rows(height, scalFac, filter, y, h, &first, &rows);
+        const uint8_t *gray = img + (first - first_row) * width;
+        if (channels != 1) {
+            grayscale(img + (first - first_row) * width * 3, tmp, width, rows, coeffs[0], coeffs[1], coeffs[2]);
+            gray = tmp;
+        }
+        if (fast) {
+            interpolate_region_fast(gray, first, width, height, scalFac, x, y, w, h, result);
+        }
+        else {
+            interpolate_region_filter(gray, first, width, height, scalFac, filter, x, y, w, h, w, result);
+        }
+        return;
     }
+    if (rect) {
+        if (channels == 1) {
+            interpolate_region(img, first_row, width, height, scalFac, rect[0], rect[1], rect[2], rect[3], result);
+        }
+        else {
+            interpolate_roi(img, first_row, width, height, coeffs[0], coeffs[1], coeffs[2], scalFac,
+                            rect[0], rect[1], rect[2], rect[3], tmp, result);
+        }
+        return;
+    }
+    // Color inputs are converted to grayscale first
+    const uint8_t *gray = img;
+    if (channels != 1) {
+        grayscale(img, tmp, width, height, coeffs[0], coeffs[1], coeffs[2]);
+        gray = tmp;
+    }
+    kernels[impl].gray(gray, width, height, scalFac, result);
+}
 
-    // Positional argument
-    FILE *instream = fopen(argv[1], "r");
-    if (instream == NULL) {
-        fprintf(stderr, "Error: Fehler beim Öffnen der Eingabedatei.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+/**
+ * This function reports the plan for the memory budget (--max-memory) and the
+ * peak memory the process actually used.
+ * @param report Output of the report
+ * @param plan Plan of the job
+ * @param budget Memory budget in bytes
+ */
+static void print_plan(FILE *report, const struct plan *plan, size_t budget) {
+    if (plan->stream) {
+        fprintf(report, "Plan: Streaming in Bändern von %lu Quellzeilen, %lu Threads, geschätzt %.1f MiB\n",
+                plan->band_rows, plan->threads, plan->bytes / 1048576.0);
+    }
+    else {
+        fprintf(report, "Plan: Ausgabepuffer, geschätzt %.1f MiB\n", plan->bytes / 1048576.0);
     }
+    fprintf(report, "Peak RSS: %.1f MiB (Budget %.1f MiB)\n", plan_peak_rss() / 1048576.0, budget / 1048576.0);
+}
+
+// Return value of parse_options if the job is to be run
+#define OPTIONS_RUN -1
+
+// Options that are checked against the table of conflicts, known after parsing
+#define OPT_ROI (1u << 0)
+#define OPT_MMAP (1u << 1)
+#define OPT_PYRAMID (1u << 2)
+#define OPT_ASCII (1u << 3)
+#define OPT_COLOR (1u << 4)
+#define OPT_FAST (1u << 5)
+#define OPT_FILTER (1u << 6)    // --filter bicubic or lanczos
+#define OPT_TILED (1u << 7)
+#define OPT_FACTORS (1u << 8)   // More than one scaling factor
+#define OPT_FRAMES (1u << 9)
+#define OPT_UPDATE (1u << 10)   // --update or --dirty
+#define OPT_CACHE (1u << 11)
+#define OPT_COUNTERS (1u << 12)
+#define OPT_NUMA (1u << 13)
+#define OPT_MEMORY (1u << 14)
+#define OPT_STDOUT (1u << 15)
+#define OPT_ALL (1u << 16)      // -V all
+#define OPT_NO_PERF (1u << 17)  // Without -B
+// Known after the header of the input was read
+#define OPT_DEEP (1u << 18)     // 16 bit input
+// Known after the memory budget was planned
+#define OPT_STREAM (1u << 19)   // Row by row processing
+#define OPT_BUFFER (1u << 20)   // One output buffer
+#define OPT_POOL (1u << 21)     // Thread pool for the tiles or bands
 
-    // Declare variables
-    size_t impl = 0;
-    int outfd;
+/**
+ * Combination of options that is not supported
+ * @param options Flags that are all set
+ * @param excludes Flags of which none may be set together with options
+ * @param msg Error message
+ */
+struct conflict {
+    unsigned options;
+    unsigned excludes;
+    const char *msg;
+};
+
+#define POOL_MSG "--threads ist nur ohne 16 Bit, --pyramid, --color und --precision fast möglich (beim Streaming auch mit --color und --precision fast), --numa nur ohne Streaming (stdin, stdout, mehrere Faktoren, 16 Bit)."
+
+static const struct conflict conflicts[] = {
+    { OPT_FACTORS, OPT_ROI | OPT_MMAP,
+      "Mehrere Skalierungsfaktoren können nicht mit --roi oder --mmap kombiniert werden." },
+    { OPT_PYRAMID, OPT_ROI,
+      "--pyramid und --roi können nicht kombiniert werden." },
+    { OPT_ASCII, OPT_MMAP | OPT_PYRAMID,
+      "--ascii kann nicht mit --mmap oder --pyramid kombiniert werden." },
+    { OPT_FAST, OPT_COLOR | OPT_PYRAMID,
+      "--precision fast kann nicht mit --color oder --pyramid kombiniert werden." },
+    { OPT_COLOR, OPT_PYRAMID,
+      "--color kann nicht mit --pyramid kombiniert werden." },
+    { OPT_TILED, OPT_ASCII | OPT_COLOR | OPT_FAST | OPT_PYRAMID | OPT_FRAMES | OPT_UPDATE,
+      "--layout tiles kann nicht mit --ascii, --color, --precision fast, --pyramid, --frames, --update oder --dirty kombiniert werden." },
+    { OPT_FILTER, OPT_COLOR | OPT_FAST | OPT_PYRAMID | OPT_FRAMES | OPT_UPDATE,
+      "--filter bicubic und lanczos können nicht mit --color, --precision fast, --pyramid, --frames, --update oder --dirty kombiniert werden." },
+    { OPT_STDOUT, OPT_FACTORS | OPT_ROI | OPT_MMAP | OPT_PYRAMID,
+      "Die Ausgabe nach stdout ist nur für einen Skalierungsfaktor ohne --roi, --mmap und --pyramid möglich." },
+    { OPT_FRAMES, OPT_ROI | OPT_PYRAMID | OPT_MMAP | OPT_ASCII | OPT_COLOR | OPT_FAST | OPT_FACTORS | OPT_CACHE |
+                  OPT_UPDATE | OPT_COUNTERS | OPT_NUMA | OPT_MEMORY | OPT_ALL,
+      "--frames kann nur mit -f N, -o, --coeffs, -j, -B und --trace kombiniert werden." },
+    { OPT_COUNTERS, OPT_STREAM | OPT_PYRAMID,
+      "--counters ist nur für ein ganzes Bild ohne Streaming (stdin, stdout, mehrere Faktoren) und ohne --pyramid möglich." },
+    { OPT_DEEP, OPT_ROI | OPT_MMAP | OPT_PYRAMID | OPT_COLOR | OPT_FAST,
+      "16 Bit Bilder können nicht mit --roi, --mmap, --pyramid, --color oder --precision fast verarbeitet werden." },
+    { OPT_DEEP, OPT_COUNTERS,
+      "--counters kann nicht mit 16 Bit Bildern verwendet werden." },
+    { OPT_FILTER, OPT_STREAM,
+      "--filter bicubic und lanczos sind nur ohne Streaming (stdin, stdout, mehrere Faktoren, 16 Bit) möglich." },
+    { OPT_UPDATE, OPT_STREAM | OPT_PYRAMID | OPT_MMAP | OPT_ROI | OPT_ASCII | OPT_COLOR | OPT_FAST | OPT_CACHE,
+      "--update und --dirty sind nur für eine binäre Graustufenausgabe ohne Streaming, --pyramid, --mmap, --roi, --ascii, --color, --precision fast und --cache möglich." },
+    { OPT_CACHE, OPT_STREAM | OPT_PYRAMID | OPT_MMAP,
+      "--cache kann nicht mit Streaming (stdin, stdout, mehrere Faktoren, 16 Bit), --pyramid oder --mmap kombiniert werden." },
+    { OPT_TILED, OPT_STREAM,
+      "--layout tiles ist nur ohne Streaming (stdin, stdout, mehrere Faktoren, 16 Bit) möglich." },
+    { OPT_POOL | OPT_STREAM, OPT_DEEP | OPT_NUMA, POOL_MSG },
+    { OPT_POOL | OPT_BUFFER, OPT_PYRAMID | OPT_COLOR | OPT_FAST, POOL_MSG },
+    { OPT_ALL, OPT_NO_PERF | OPT_POOL | OPT_STREAM | OPT_ROI | OPT_COLOR | OPT_FAST | OPT_FILTER | OPT_COUNTERS |
+               OPT_PYRAMID | OPT_UPDATE | OPT_CACHE,
+      "-V all ist nur mit -B für ein ganzes Graustufenbild ohne Streaming, --threads, --layout tiles, --numa, --roi, --color, --precision fast, --filter, --counters, --pyramid, --update und --cache möglich." },
+};
+
+/**
+ * Settings of a run: the parsed options and what follows from them and from
+ * the header of the input
+ * @param progname Name of the program
+ * @param inpath Input file, "-" for stdin
+ * @param impl Version of the kernel
+ * @param impl_auto Take the implementation from the profile of --tune
+ * @param impl_all Benchmark all kernels (-V all)
+ * @param outname Output file without extension, "-" for stdout
+ * @param scalFac First scaling factor
+ * @param factors All scaling factors passed with -f
+ * @param nfactors Number of scaling factors
+ * @param coeffs Coefficients of the grayscale conversion, 0 for the defaults of grayscale
+ * @param perf Measure the runtime (-B)
+ * @param loops Repetitions of the measurement
+ * @param use_mmap Map the output file and let the kernel write into it directly
+ * @param ascii Write the output as ASCII image (P2)
+ * @param color Scale the color planes instead of the grayscale image
+ * @param fast Fast kernel with quantized weights instead of the exact one
+ * @param filter Resampling filter (FILTER_*)
+ * @param tiled Write the output as contiguous tiles of tile pixels
+ * @param roi Only compute the window roi_rect of the output image
+ * @param roi_rect Window of the output image: x, y, w, h
+ * @param pyramid_dir Root of the tile cache in pyramid mode
+ * @param tile Edge length of the tiles of --pyramid and --layout tiles
+ * @param counters Report hardware counters per stage
+ * @param trace_path Output file of the timeline trace
+ * @param threads Workers of the thread pool
+ * @param threads_set -j was given, the profile doesn't change the threads
+ * @param numa Placement of the workers and buffers (NUMA_*)
+ * @param serve_path Socket of the daemon mode
+ * @param cache_dir Directory of the result cache
+ * @param update_prev Previous input of an incremental update
+ * @param dirty_rects Changed source rectangles: x, y, w, h
+ * @param ndirty Number of changed source rectangles
+ * @param frames Input is a stream of concatenated frames
+ * @param max_memory Memory budget in bytes, 0 for none
+ * @param tune Benchmark this machine and write the profile
+ * @param profile_path Profile of --tune and -V auto, NULL if there is none
+ * @param default_profile Storage of the default profile path
+ * @param instream Input stream
+ * @param to_stdout The output is written to stdout
+ * @param stream The rows are processed with constant memory instead of one output buffer
+ * @param updating Incremental update (--update or --dirty)
+ * @param layout Edge length of the output tiles, 0 for row-major output
+ * @param header Header of the input
+ * @param reader Reader of the image data
+ * @param channels Samples per input pixel (1 or 3)
+ * @param out_channels Samples per output pixel (1 or 3)
+ * @param deep 16 bit input
+ * @param out_maxval Maximum value of the output
+ * @param tuned The profile was loaded, it gave the implementation unless --precision fast is set
+ * @param profile Profile of -V auto
+ * @param plan Plan of the memory budget
+ * @param use_pool The tiles run on the thread pool
+ * @param topo NUMA topology (--numa)
+ * @param ext Extension of the output file
+ * @param out_width Width of the output image (of the window with --roi)
+ * @param out_height Height of the output image (of the window with --roi)
+ * @param img Source rows that were read
+ * @param first_row Index of the first source row in img
+ * @param row_count Number of source rows in img
+ * @param pc Hardware counters (--counters)
+ * @param stages Stages of the counter report
+ * @param trace_read Start of the read phase in the trace
+ */
+struct job {
+    const char *progname;
+    const char *inpath;
+    size_t impl;
+    bool impl_auto;
+    bool impl_all;
     char *outname;
-    size_t scalFac = 0;
-    float coeffs[3] = { 0, 0, 0 }; // If the user doesn't input anything default values will be set in grayscale
-    size_t width, height;
-    bool perf = false;
-    size_t loops = 10; // Default value for how often the function should execute for performance testing
-    
+    size_t scalFac;
+    size_t factors[MAX_FACTORS];
+    size_t nfactors;
+    float coeffs[3];
+    bool perf;
+    size_t loops;
+    bool use_mmap;
+    bool ascii;
+    bool color;
+    bool fast;
+    int filter;
+    bool tiled;
+    bool roi;
+    size_t roi_rect[4];
+    char *pyramid_dir;
+    size_t tile;
+    bool counters;
+    char *trace_path;
+    size_t threads;
+    bool threads_set;
+    int numa;
+    char *serve_path;
+    char *cache_dir;
+    char *update_prev;
+    size_t dirty_rects[4 * UPDATE_MAX_RECTS];
+    size_t ndirty;
+    bool frames;
+    size_t max_memory;
+    bool tune;
+    char *profile_path;
+    char default_profile[PATH_MAX];
+    FILE *instream;
+    bool to_stdout;
+    bool stream;
+    bool updating;
+    size_t layout;
+    struct pnm_header header;
+    struct pnm_reader reader;
+    size_t channels;
+    size_t out_channels;
+    bool deep;
+    size_t out_maxval;
+    bool tuned;
+    struct tune_profile profile;
+    struct plan plan;
+    bool use_pool;
+    struct numa_topology topo;
+    const char *ext;
+    size_t out_width;
+    size_t out_height;
+    uint8_t *img;
+    size_t first_row;
+    size_t row_count;
+    struct perf_counters pc;
+    struct perf_stage stages[STAGES];
+    uint64_t trace_read;
+};
+
+/**
+ * This function parses the command line into the job.
+ * @param job Job to be filled
+ * @param argc argument count
+ * @param argv[] array of arguments
+ * @return OPTIONS_RUN if the job is to be run, otherwise the exit code (--help,
+ * --list-kernels or an invalid option)
+ */
+static int parse_options(struct job *job, int argc, char *argv[]) {
+    const char *progname = argv[0];
+    *job = (struct job){
+        .progname = progname,
+        // getopt reorders argv, so the input file is taken before the options are parsed
+        .inpath = argv[1],
+        .impl_auto = true,
+        .loops = 10, // Default value for how often the function should execute for performance testing
+        .filter = FILTER_BILINEAR,
+        .tile = 256,
+        .threads = 1,
+        .numa = NUMA_OFF,
+        .stages = {
+            { .name = "Einlesen" },
+            { .name = "Graustufen" },
+            { .name = "Platzierung" },
+            { .name = "Interpolation" },
+            { .name = "Schreiben" },
+        },
+    };
+
     // Regex to check for floats in coeffs
     regex_t rex;
     if (regcomp(&rex, "[[:digit:]+][.][[:digit:]+]", 0)) {
@@ -136,30 +551,56 @@ int main(int argc, char *argv[]) {
     static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"coeffs", required_argument, 0, 'c'},
+        {"mmap", no_argument, 0, 'm'},
+        {"ascii", no_argument, 0, 'a'},
+        {"color", no_argument, 0, 'C'},
+        {"precision", required_argument, 0, 'P'},
+        {"roi", required_argument, 0, 'r'},
+        {"pyramid", required_argument, 0, 'p'},
+        {"tile", required_argument, 0, 't'},
+        {"counters", no_argument, 0, 'K'},
+        {"trace", required_argument, 0, 'T'},
+        {"threads", required_argument, 0, 'j'},
+        {"numa", required_argument, 0, 'N'},
+        {"serve", required_argument, 0, 'S'},
+        {"cache", required_argument, 0, 'R'},
+        {"update", required_argument, 0, 'U'},
+        {"dirty", required_argument, 0, 'D'},
+        {"frames", no_argument, 0, 'F'},
+        {"filter", required_argument, 0, 'L'},
+        {"layout", required_argument, 0, 'Y'},
+        {"max-memory", required_argument, 0, 'M'},
+        {"tune", no_argument, 0, 'A'},
+        {"profile", required_argument, 0, 'Q'},
+        {"list-kernels", no_argument, 0, 'I'},
         {0, 0, 0, 0}
     };
     // Check if the next optional argument is indeed on of the valid ones
     // x:  -> The parameter x must have a argument
     // x:: -> The parameter x may have a argument (optional argument)
     // x   -> The parameter x must have zero arguments
-    while ((opt = getopt_long(argc, argv, "V:B::o:c:f:h", long_options, NULL)) !=
+    while ((opt = getopt_long(argc, argv, "V:B::o:c:f:r:j:mah", long_options, NULL)) !=
         -1) {
         switch (opt) {
-            case 'V': // Implementation version
-                is_digit(optarg, progname);
-                impl = strtoul(optarg, NULL, 10);
-                if (errno == ERANGE || impl > VERSIONS) {
-                    fprintf(stderr, "Error: Das Argument 'V' muss zwischen 0 und %d sein.\n", VERSIONS);
+            case 'V': { // Implementation version or name
+                job->impl_auto = strcmp(optarg, "auto") == 0;
+                job->impl_all = strcmp(optarg, "all") == 0;
+                int version = kernel_find(optarg);
+                if (!job->impl_auto && !job->impl_all && version < 0) {
+                    fprintf(stderr, "Error: Das Argument 'V' muss eine Implementierung aus --list-kernels (0 bis %lu oder ihr Name), auto oder all sein.\n",
+                            nkernels - 1);
                     print_usage(progname);
                     return EXIT_FAILURE;
                 }
+                job->impl = (version < 0) ? 0 : (size_t)version;
                 break;
+            }
             case 'B': // Runtime measurement
-                perf = true;
+                job->perf = true;
                 if (optind < argc && *argv[optind] != '-') {
                     is_digit(argv[optind], progname);
-                    loops = strtoul(argv[optind], NULL, 10);
-                    if (errno == ERANGE || loops == 0 || loops >= INT32_MAX) {
+                    job->loops = strtoul(argv[optind], NULL, 10);
+                    if (errno == ERANGE || job->loops == 0 || job->loops >= INT32_MAX) {
                         fprintf(stderr, "Error: Die Performanzwiederholungen darf nicht 0 bzw. größer als INT_MAX sein.\n");
                         print_usage(progname);
                         return EXIT_FAILURE;
@@ -167,7 +608,7 @@ int main(int argc, char *argv[]) {
                 }
                 break;
             case 'o': // Output file
-                outname = optarg;
+                job->outname = optarg;
                 break;
             case 'c': // Coefficients
                 ; // Fixed "A label can only be part of a statement"
@@ -183,7 +624,7 @@ int main(int argc, char *argv[]) {
                         print_usage(progname);
                         return EXIT_FAILURE;
                     }
-                    coeffs[i++] = atof(fs);
+                    job->coeffs[i++] = atof(fs);
                     fs = strtok(NULL, ",");
                 }
                 // Check if there are enough coeffs
@@ -193,15 +634,205 @@ int main(int argc, char *argv[]) {
                     return EXIT_FAILURE;
                 }
                 break;
-            case 'f': // Scaling factor
+            case 'f': // Scaling factor(s)
+                job->nfactors = 0;
+                char *fsf = strtok(optarg, ",");
+                while (fsf != NULL) {
+                    is_digit(fsf, progname);
+                    if (job->nfactors == MAX_FACTORS) {
+                        fprintf(stderr, "Error: Es dürfen höchstens %d Skalierungsfaktoren angegeben werden.\n", MAX_FACTORS);
+                        print_usage(progname);
+                        return EXIT_FAILURE;
+                    }
+                    job->factors[job->nfactors] = strtoul(fsf, NULL, 10);
+                    if (errno == ERANGE || job->factors[job->nfactors] == 0) {
+                        fprintf(stderr, "Error: Der Skalierungsfaktor darf nicht 0 bzw. größer als ULONG_MAX sein.\n");
+                        print_usage(progname);
+                        return EXIT_FAILURE;
+                    }
+                    job->nfactors++;
+                    fsf = strtok(NULL, ",");
+                }
+                job->scalFac = (job->nfactors > 0) ? job->factors[0] : 0;
+                break;
+            case 'p': // Zoom pyramid
+                job->pyramid_dir = optarg;
+                break;
+            case 't': // Tile size of the pyramid
+                is_digit(optarg, progname);
+                job->tile = strtoul(optarg, NULL, 10);
+                if (errno == ERANGE || job->tile == 0 || job->tile > 65536) {
+                    fprintf(stderr, "Error: Die Kachelgröße muss zwischen 1 und 65536 liegen.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r': // Region of interest
+                job->roi = true;
+                char *rs = strtok(optarg, ",");
+                int n = 0;
+                while (rs != NULL && n < 4) {
+                    is_digit(rs, progname);
+                    job->roi_rect[n++] = strtoul(rs, NULL, 10);
+                    rs = strtok(NULL, ",");
+                }
+                if (n != 4 || rs != NULL || errno == ERANGE || job->roi_rect[2] == 0 || job->roi_rect[3] == 0) {
+                    fprintf(stderr, "Error: Das Fenster muss als x,y,w,h mit w, h > 0 angegeben werden.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm': // Memory-mapped output
+                job->use_mmap = true;
+                break;
+            case 'a': // ASCII output
+                job->ascii = true;
+                break;
+            case 'j': // Threads
                 is_digit(optarg, progname);
-                scalFac = strtoul(optarg, NULL, 10);
-                if (errno == ERANGE || scalFac == 0) {
-                    fprintf(stderr, "Error: Der Skalierungsfaktor darf nicht 0 bzw. größer als ULONG_MAX sein.\n");
+                job->threads = strtoul(optarg, NULL, 10);
+                if (errno == ERANGE || job->threads == 0 || job->threads > POOL_MAX_WORKERS) {
+                    fprintf(stderr, "Error: Die Anzahl der Threads muss zwischen 1 und %d liegen.\n", POOL_MAX_WORKERS);
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                job->threads_set = true;
+                break;
+            case 'U': // Incremental update
+                job->update_prev = optarg;
+                break;
+            case 'D': // Dirty rectangle
+                if (job->ndirty == UPDATE_MAX_RECTS) {
+                    fprintf(stderr, "Error: Es dürfen höchstens %d Bereiche angegeben werden.\n", UPDATE_MAX_RECTS);
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                char *ds = strtok(optarg, ",");
+                int nd = 0;
+                while (ds != NULL && nd < 4) {
+                    is_digit(ds, progname);
+                    job->dirty_rects[4 * job->ndirty + nd++] = strtoul(ds, NULL, 10);
+                    ds = strtok(NULL, ",");
+                }
+                if (nd != 4 || ds != NULL || errno == ERANGE) {
+                    fprintf(stderr, "Error: Der Bereich muss als x,y,w,h angegeben werden.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                job->ndirty++;
+                break;
+            case 'F': // Frame stream
+                job->frames = true;
+                break;
+            case 'R': // Result cache
+                job->cache_dir = optarg;
+                break;
+            case 'S': // Daemon mode
+                job->serve_path = optarg;
+                break;
+            case 'N': // NUMA placement
+                if (strcmp(optarg, "off") == 0) {
+                    job->numa = NUMA_OFF;
+                }
+                else if (strcmp(optarg, "cores") == 0) {
+                    job->numa = NUMA_CORES;
+                }
+                else if (strcmp(optarg, "nodes") == 0) {
+                    job->numa = NUMA_NODES;
+                }
+                else {
+                    fprintf(stderr, "Error: Die NUMA-Platzierung muss 'off', 'cores' oder 'nodes' sein.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'T': // Timeline trace
+                job->trace_path = optarg;
+                break;
+            case 'K': // Hardware counters
+                job->counters = true;
+                job->perf = true;
+                break;
+            case 'C': // Color output
+                job->color = true;
+                break;
+            case 'P': // Precision tier
+                if (strcmp(optarg, "fast") == 0) {
+                    job->fast = true;
+                }
+                else if (strcmp(optarg, "exact") == 0) {
+                    job->fast = false;
+                }
+                else {
+                    fprintf(stderr, "Error: Die Präzision muss 'fast' oder 'exact' sein.\n");
                     print_usage(progname);
                     return EXIT_FAILURE;
                 }
                 break;
+            case 'L': // Resampling filter
+                if (strcmp(optarg, "bilinear") == 0) {
+                    job->filter = FILTER_BILINEAR;
+                }
+                else if (strcmp(optarg, "bicubic") == 0) {
+                    job->filter = FILTER_BICUBIC;
+                }
+                else if (strcmp(optarg, "lanczos") == 0) {
+                    job->filter = FILTER_LANCZOS;
+                }
+                else {
+                    fprintf(stderr, "Error: Der Filter muss 'bilinear', 'bicubic' oder 'lanczos' sein.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'Y': // Output layout
+                if (strcmp(optarg, "tiles") == 0) {
+                    job->tiled = true;
+                }
+                else if (strcmp(optarg, "rows") == 0) {
+                    job->tiled = false;
+                }
+                else {
+                    fprintf(stderr, "Error: Das Layout muss 'rows' oder 'tiles' sein.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M': { // Memory budget
+                char *end;
+                errno = 0;
+                size_t max_memory = strtoul(optarg, &end, 10);
+                size_t unit = 1;
+                if (*end == 'K' || *end == 'k') {
+                    unit = 1ul << 10;
+                    end++;
+                }
+                else if (*end == 'M' || *end == 'm') {
+                    unit = 1ul << 20;
+                    end++;
+                }
+                else if (*end == 'G' || *end == 'g') {
+                    unit = 1ul << 30;
+                    end++;
+                }
+                if (errno == ERANGE || end == optarg || *end != '\0' || !isdigit((unsigned char)optarg[0]) ||
+                    max_memory == 0 || max_memory > SIZE_MAX / unit) {
+                    fprintf(stderr, "Error: Das Speicherbudget muss eine positive Zahl von Bytes sein, optional mit K, M oder G.\n");
+                    print_usage(progname);
+                    return EXIT_FAILURE;
+                }
+                job->max_memory = max_memory * unit;
+                break;
+            }
+            case 'A': // Tuning mode
+                job->tune = true;
+                break;
+            case 'Q': // Profile
+                job->profile_path = optarg;
+                break;
+            case 'I': // List of the kernels
+                kernel_list(stdout);
+                return EXIT_SUCCESS;
             case 'h': // Help
                 print_help(progname);
                 return EXIT_SUCCESS;
@@ -213,265 +844,1130 @@ int main(int argc, char *argv[]) {
                 break;
         }
     }
+    regfree(&rex);
+    return OPTIONS_RUN;
+}
 
-    // Check for enough optional arguments
-    if (scalFac == 0 || !outname) {
-        fprintf(stderr, "Error: Skalierungsfaktor oder Ausgabedatei wurde nicht angegeben.\n");
-        print_usage(progname);
+/**
+ * This function collects the flags of the options for the table of conflicts.
+ * @param job Parsed options
+ * @return OPT_* flags that are known after parsing
+ */
+static unsigned option_flags(const struct job *job) {
+    unsigned flags = 0;
+    flags |= job->roi ? OPT_ROI : 0;
+    flags |= job->use_mmap ? OPT_MMAP : 0;
+    flags |= job->pyramid_dir ? OPT_PYRAMID : 0;
+    flags |= job->ascii ? OPT_ASCII : 0;
+    flags |= job->color ? OPT_COLOR : 0;
+    flags |= job->fast ? OPT_FAST : 0;
+    flags |= (job->filter != FILTER_BILINEAR) ? OPT_FILTER : 0;
+    flags |= job->tiled ? OPT_TILED : 0;
+    flags |= (job->nfactors > 1) ? OPT_FACTORS : 0;
+    flags |= job->frames ? OPT_FRAMES : 0;
+    flags |= (job->update_prev || job->ndirty > 0) ? OPT_UPDATE : 0;
+    flags |= job->cache_dir ? OPT_CACHE : 0;
+    flags |= job->counters ? OPT_COUNTERS : 0;
+    flags |= (job->numa != NUMA_OFF) ? OPT_NUMA : 0;
+    flags |= job->max_memory ? OPT_MEMORY : 0;
+    flags |= job->to_stdout ? OPT_STDOUT : 0;
+    flags |= job->impl_all ? OPT_ALL : 0;
+    flags |= job->perf ? 0 : OPT_NO_PERF;
+    return flags;
+}
+
+/**
+ * This function checks the flags against the table of conflicts. The flags
+ * grow while the job is prepared, so it is called once per step and a
+ * conflict is reported as soon as its flags are known.
+ * @param flags OPT_* flags of the job
+ * @param progname Name of the program
+ * @return 0 if the options can be combined, -1 otherwise
+ */
+static int check_conflicts(unsigned flags, const char *progname) {
+    for (size_t i = 0; i < sizeof(conflicts) / sizeof(conflicts[0]); i++) {
+        if ((flags & conflicts[i].options) == conflicts[i].options && (flags & conflicts[i].excludes)) {
+            fprintf(stderr, "Error: %s\n", conflicts[i].msg);
+            print_usage(progname);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * This function runs the daemon mode (--serve), the jobs name their own input
+ * files. It only returns if the socket could not be opened.
+ * @param job Parsed options
+ * @return Exit code
+ */
+static int run_serve(const struct job *job) {
+    serve(job->serve_path, job->threads);
+    fprintf(stderr, "Error: Der Socket %s konnte nicht geöffnet werden.\n", job->serve_path);
+    print_usage(job->progname);
+    return EXIT_FAILURE;
+}
+
+/**
+ * This function benchmarks this machine (--tune) and stores the measurements
+ * for -V auto. It needs no input file.
+ * @param job Parsed options
+ * @return Exit code
+ */
+static int run_tune(const struct job *job) {
+    if (!job->profile_path) {
+        fprintf(stderr, "Error: Ohne HOME muss das Profil mit --profile angegeben werden.\n");
+        print_usage(job->progname);
         return EXIT_FAILURE;
     }
+    // Up to -j threads, otherwise up to all CPUs
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = job->threads_set ? job->threads : (ncpu > 0) ? (size_t)ncpu : 1;
+    max_threads = (max_threads < POOL_MAX_WORKERS) ? max_threads : POOL_MAX_WORKERS;
+    switch (tune_run(job->profile_path, max_threads, stdout)) {
+        case 0:
+            break;
+        case TUNE_ERR_OPEN:
+            fprintf(stderr, "Error: Das Profil %s konnte nicht geschrieben werden.\n", job->profile_path);
+            print_usage(job->progname);
+            return EXIT_FAILURE;
+        default:
+            fprintf(stderr, "Error: Speicherallokation für die Messungen hat nicht funktioniert.\n");
+            print_usage(job->progname);
+            return EXIT_FAILURE;
+    }
+    fprintf(stdout, "Profil in: %s\n", job->profile_path);
+    return EXIT_SUCCESS;
+}
 
-    // Open output file
-    outfd = open(strcat(outname, ".pgm"), O_CREAT | O_WRONLY | O_TRUNC, S_IRWXU);
-    if (outfd < 0) {
-        fprintf(stderr, "Error: Fehler beim erstellen der Ausgabedatei.\n");
+/**
+ * This function checks the kernel chosen with -V: it has to run on this CPU,
+ * fast kernels imply --precision fast and filter kernels --filter. Without -V
+ * --precision fast selects the fast kernel.
+ * @param job Job, impl, fast and filter are set from each other
+ * @return 0 on success, -1 otherwise
+ */
+static int select_kernel(struct job *job) {
+    if (job->impl_auto && job->fast) {
+        job->impl = (size_t)kernel_find("fast");
+    }
+    else if (job->impl_auto || job->impl_all) {
+        return 0;
+    }
+    const struct kernel *kernel = &kernels[job->impl];
+    if (!kernel_supports(kernel, job->scalFac)) {
+        fprintf(stderr, "Error: Die Implementierung %s unterstützt diese CPU oder den Skalierungsfaktor %lu nicht (siehe --list-kernels).\n",
+                kernel->name, job->scalFac);
+        print_usage(job->progname);
+        return -1;
+    }
+    if (kernel->precision == KERNEL_FAST) {
+        job->fast = true;
+    }
+    else if (job->fast && kernel->filter == FILTER_BILINEAR) {
+        fprintf(stderr, "Error: -V %s ist exakt, --precision fast verwendet -V fast.\n", kernel->name);
+        print_usage(job->progname);
+        return -1;
+    }
+    if (kernel->filter != FILTER_BILINEAR) {
+        if (job->filter != FILTER_BILINEAR && job->filter != kernel->filter) {
+            fprintf(stderr, "Error: -V %s und --filter geben verschiedene Filter an.\n", kernel->name);
+            print_usage(job->progname);
+            return -1;
+        }
+        job->filter = kernel->filter;
+    }
+    return 0;
+}
+
+/**
+ * This function reads the header of the input. For ppm format reference look
+ * here: https://stackoverflow.com/questions/69581117/how-to-read-images-using-c
+ * The header is only read forward, so the input can be a pipe.
+ * @param job Job with the open input, the header and the sample formats are set
+ * @return 0 on success, -1 otherwise
+ */
+static int read_header(struct job *job) {
+    const char *progname = job->progname;
+    switch (pnm_read_header(job->instream, &job->header)) {
+        case 0:
+            break;
+        case PNM_ERR_MAGIC:
+            fprintf(stderr, "Error: Falsche \"Magic Number\" der Eingabedatei.\n");
+            print_usage(progname);
+            return -1;
+        case PNM_ERR_SIZE:
+            fprintf(stderr, "Error: Breite oder Höhe fehlt bzw. ist größer als ULONG_MAX.\n");
+            print_usage(progname);
+            return -1;
+        case PNM_ERR_MAXVAL:
+            fprintf(stderr, "Error: Der maximale Wert in der Eingabedatei fehlt oder ist größer 65535 was keinem 8 oder 16 Bit Bild entspricht.\n");
+            print_usage(progname);
+            return -1;
+        case PNM_ERR_SPACE:
+            fprintf(stderr, "Error: Whitespace nach dem maximalen Wert in der Eingabedatei existiert nicht.\n");
+            print_usage(progname);
+            return -1;
+        default:
+            fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return -1;
+    }
+    // Grayscale inputs (P5, P2) need no conversion
+    job->channels = pnm_channels(&job->header);
+    if (job->color && job->channels != 3) {
+        fprintf(stderr, "Error: --color benötigt ein Farbbild (P6 oder P3) als Eingabe.\n");
         print_usage(progname);
-        return EXIT_FAILURE;
+        return -1;
     }
+    job->out_channels = job->color ? 3 : 1;
+    // 16 bit images keep their maxval and are always processed row by row
+    job->deep = pnm_sample_bytes(&job->header) == 2;
+    job->out_maxval = job->deep ? job->header.maxval : 255;
+    return 0;
+}
 
-    // For ppm format reference look here: https://stackoverflow.com/questions/69581117/how-to-read-images-using-c
-    // Check if reading file is working
-    // Write the first 8 byte into buffer
-    // These are meta data of the image
-    // 1. Magic Number Test
-    char buf[2];
-    if (fread(buf, sizeof(char), sizeof(buf), instream) == 0) {
-        fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+/**
+ * This function interpolates a stream of concatenated frames (--frames). Every
+ * frame is interpolated on its own, the pool works on several frames at once.
+ * @param job Job with the header of the first frame
+ * @return Exit code
+ */
+static int run_frames(struct job *job) {
+    const char *progname = job->progname;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", job->to_stdout ? "stdout" : job->outname, job->to_stdout ? "" : ".pgm");
+    FILE *outstream = job->to_stdout ? stdout : fopen(path, "wb");
+    if (outstream == NULL) {
+        fprintf(stderr, "Error: Fehler beim erstellen der Ausgabedatei.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
-    if (buf[0] != 'P' || buf[1] != '6') {
-        fprintf(stderr, "Error: Falsche \"Magic Number\" der Eingabedatei.\n");
-        print_usage(progname);
+    FILE *report = job->to_stdout ? stderr : stdout;
+    struct timespec start;
+    struct timespec end;
+    size_t nframes;
+    clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
+    int ret = interpolate_frames(job->instream, &job->header, job->coeffs[0], job->coeffs[1], job->coeffs[2],
+                                 job->scalFac, job->threads, outstream, &nframes);
+    clock_gettime(1, &end);
+    switch (ret) {
+        case 0:
+            break;
+        case FRAMES_ERR_MEMORY:
+            fprintf(stderr, "Error: Speicherallokation für das Ausgabebild hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case FRAMES_ERR_READ:
+            fprintf(stderr, "Error: Lesen von Frame %lu hat nicht funktioniert.\n", nframes + 1);
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case FRAMES_ERR_FORMAT:
+            fprintf(stderr, "Error: Alle Frames müssen binäre 8 Bit Bilder (P6, P5) der gleichen Größe sein.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        default:
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+    }
+    fclose(job->instream);
+    if (fclose(outstream) != 0) {
+        fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
         return EXIT_FAILURE;
     }
 
-    // 2. Whitespace
-    jumpWhitespace(instream, progname);
+    fprintf(report, "===========================================\n");
+    fprintf(report, "Ergebnisse:\n");
+    fprintf(report, "Frames: %lu\n", nframes);
+    if (job->perf) {
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        fprintf(report, "Laufzeit: %f Sekunden (%f Frames pro Sekunde)\n", time, time > 0 ? nframes / time : 0);
+    }
+    fprintf(report, "Ausgabe in: %s\n", path);
+    fprintf(report, "===========================================\n");
+    return EXIT_SUCCESS;
+}
 
-    // 3. Width
-    char buf2[100];
-    int wcount = 0;
-    while (isspace(buf2[wcount] = fgetc(instream)) == 0) {
-        wcount++;
+/**
+ * This function loads the profile of -V auto: the fastest implementation of
+ * the profile (except for --precision fast), without -j also its threads and
+ * band height.
+ * @param job Job with the header, impl, threads and the profile are set
+ */
+static void load_profile(struct job *job) {
+    if (!job->impl_auto || !job->profile_path) {
+        return;
+    }
+    switch (tune_load(job->profile_path, &job->profile)) {
+        case 0:
+            job->tuned = true;
+            // --precision fast keeps the fast kernel, the profile only gives the threads and the band height
+            if (!job->fast) {
+                job->impl = tune_impl(&job->profile, job->scalFac, job->header.width);
+                // The profile only names kernels with the output of V0, but the factor may be beyond the measured ones
+                if (!kernel_supports(&kernels[job->impl], job->scalFac) || kernels[job->impl].precision != KERNEL_EXACT) {
+                    job->impl = 0;
+                }
+            }
+            break;
+        case TUNE_ERR_OPEN:
+            break;
+        case TUNE_ERR_CPU:
+            fprintf(stderr, "Warnung: Das Profil %s wurde auf einer anderen CPU gemessen, -V auto verwendet %ld.\n", job->profile_path,
+                    job->impl);
+            break;
+        default:
+            fprintf(stderr, "Warnung: Das Profil %s ist ungültig, -V auto verwendet %ld.\n", job->profile_path, job->impl);
+            break;
     }
-    char widthStr[wcount];
-    for (int i = 0; i < wcount; i++) {
-        widthStr[i] = buf2[i];
+    if (job->tuned && !job->threads_set && !job->counters && job->profile.threads > 1 && job->numa == NUMA_OFF &&
+        !job->deep && !job->pyramid_dir && (job->stream || (!job->color && !job->fast))) {
+        job->threads = job->profile.threads;
     }
-    width = strtoul(widthStr, NULL, 10);
-    if (errno == ERANGE) {
-        fprintf(stderr, "Error: Die Breite darf nicht größer als ULONG_MAX sein.\n");
+}
+
+/**
+ * This function interpolates row by row while the input is still arriving.
+ * Pipes and several factors are processed this way with constant memory.
+ * @param job Job with the reader positioned at the first row
+ * @return Exit code
+ */
+static int run_stream(struct job *job) {
+    const char *progname = job->progname;
+    size_t nfactors = job->nfactors;
+    FILE *outstreams[MAX_FACTORS];
+    char outpaths[MAX_FACTORS][PATH_MAX];
+    // Results go to stderr if the image is written to stdout
+    FILE *report = job->to_stdout ? stderr : stdout;
+    for (size_t k = 0; k < nfactors; k++) {
+        if (job->to_stdout) {
+            snprintf(outpaths[k], PATH_MAX, "stdout");
+            outstreams[k] = stdout;
+        }
+        else {
+            if (nfactors > 1) {
+                snprintf(outpaths[k], PATH_MAX, "%s_%lu%s", job->outname, job->factors[k], job->ext);
+            }
+            else {
+                snprintf(outpaths[k], PATH_MAX, "%s%s", job->outname, job->ext);
+            }
+            outstreams[k] = fopen(outpaths[k], "wb");
+        }
+        if (outstreams[k] == NULL) {
+            fprintf(stderr, "Error: Fehler beim erstellen der Ausgabedatei.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        char metadata[METADATA_MAX];
+        size_t metalen = create_metadata(metadata, job->ascii, job->out_channels, job->out_maxval,
+                                         job->header.width * job->factors[k], job->header.height * job->factors[k]);
+        fwrite(metadata, sizeof(char), metalen, outstreams[k]);
+    }
+
+    // The source rows of a band are spread over the threads
+    size_t threads = job->threads;
+    size_t band_rows = job->max_memory ? job->plan.band_rows : job->tuned ? threads * job->profile.band : threads;
+    struct pool stream_pool;
+    if (threads > 1 && pool_create(&stream_pool, threads) != 0) {
+        fprintf(stderr, "Error: Starten der Threads hat nicht funktioniert.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
-    fseek(instream, -1, SEEK_CUR);
-
-    // 4. Whitespace
-    jumpWhitespace(instream, progname);
 
-    // 5. Height
-    char buf3[100];
-    int hcount = 0;
-    while (isspace(buf3[hcount] = fgetc(instream)) == 0) {
-        hcount++;
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
+    uint64_t t = trace_begin();
+    int ret = interpolate_stream(&job->reader, job->coeffs[0], job->coeffs[1], job->coeffs[2], job->factors, nfactors,
+                                 outstreams, job->ascii, job->color, job->fast, band_rows,
+                                 threads > 1 ? &stream_pool : NULL);
+    trace_end("Streaming", -1, t);
+    clock_gettime(1, &end);
+    if (threads > 1) {
+        pool_destroy(&stream_pool);
     }
-    char heightStr[hcount];
-    for (int i = 0; i < hcount; i++) {
-        heightStr[i] = buf3[i];
+    switch (ret) {
+        case 0:
+            break;
+        case STREAM_ERR_MEMORY:
+            fprintf(stderr, "Error: Speicherallokation für das Ausgabebild hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case STREAM_ERR_READ:
+            fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case STREAM_ERR_DATA:
+            fprintf(stderr, "Error: Die Bilddaten der Eingabedatei sind ungültig.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        default:
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
     }
-    height = strtoul(heightStr, NULL, 10);
-    if (errno == ERANGE) {
-        fprintf(stderr, "Error: Die Höhe darf nicht größer als ULONG_MAX sein.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+    pnm_reader_free(&job->reader);
+    fclose(job->instream);
+    for (size_t k = 0; k < nfactors; k++) {
+        if (fclose(outstreams[k]) != 0) {
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            return EXIT_FAILURE;
+        }
     }
-    fseek(instream, -1, SEEK_CUR);
 
-    // 6. Whitespace
-    jumpWhitespace(instream, progname);
+    fprintf(report, "===========================================\n");
+    fprintf(report, "Ergebnisse:\n");
+    if (threads > 1) {
+        fprintf(report, "Threads: %lu\n", threads);
+    }
+    if (job->max_memory) {
+        print_plan(report, &job->plan, job->max_memory);
+    }
+    if (job->perf) {
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        fprintf(report, "Laufzeit: %f Sekunden\n", time);
+    }
+    for (size_t k = 0; k < nfactors; k++) {
+        fprintf(report, "Ausgabe in: %s\n", outpaths[k]);
+    }
+    fprintf(report, "===========================================\n");
+    return EXIT_SUCCESS;
+}
 
-    // 7. Maxval Test
-    char buf4[100];
-    int mcount = 0;
-    while (isspace(buf4[mcount] = fgetc(instream)) == 0) {
-        mcount++;
+/**
+ * This function checks that the output of a scaling factor has a size that
+ * fits into size_t: the pixels times the samples per pixel and the bytes per
+ * sample, and for the tiled layout the padded slots of all tiles and the index.
+ * @param job Job with the header of the input
+ * @param factor Scaling factor
+ * @return 0 if no size overflows, -1 otherwise
+ */
+static int check_output_size(const struct job *job, size_t factor) {
+    size_t width = job->header.width;
+    size_t height = job->header.height;
+    if (width == 0 || height == 0) {
+        return 0;
     }
-    char maxStr[mcount];
-    for (int i = 0; i < mcount; i++) {
-        maxStr[i] = buf4[i];
+    if (factor > SIZE_MAX / width || factor > SIZE_MAX / height) {
+        return -1;
     }
-    if (atol(maxStr) > 255) {
-        fprintf(stderr, "Error: Der maximale Wert in der Eingabedatei ist größer 255 was keinem 24bpp Bild entspricht.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+    size_t out_width = width * factor;
+    size_t out_height = height * factor;
+    size_t pixel_bytes = job->out_channels * pnm_sample_bytes(&job->header);
+    if (out_height > SIZE_MAX / out_width || out_width * out_height > SIZE_MAX / pixel_bytes) {
+        return -1;
     }
-    fseek(instream, -1, SEEK_CUR);
-    
-    // 8. Whitespace
-    if (isspace(fgetc(instream)) == 0) {
-        fprintf(stderr, "Error: Whitespace nach dem maximalen Wert in der Eingabedatei existiert nicht.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+    if (job->layout) {
+        // The tile data has a slot of a full tile per tile, the header an index entry per tile
+        size_t tile = job->layout;
+        size_t count = (out_width / tile + (out_width % tile != 0)) * (out_height / tile + (out_height % tile != 0));
+        size_t slot = layout_offset(tile, job->out_channels, 1);
+        if (count > SIZE_MAX / slot ||
+            count > (SIZE_MAX - sizeof(struct layout_header) - LAYOUT_ALIGN) / sizeof(struct layout_entry)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * This function reads the source rows of the output image, with --roi only
+ * the rows below the window, and closes the input.
+ * @param job Job with the reader positioned at the first row, img, first_row,
+ * row_count and the size of the output are set
+ * @return 0 on success, -1 otherwise
+ */
+static int read_image(struct job *job) {
+    const char *progname = job->progname;
+    size_t width = job->header.width;
+    size_t height = job->header.height;
+    job->out_width = width * job->scalFac;
+    job->out_height = height * job->scalFac;
+    job->first_row = 0;
+    job->row_count = height;
+    if (job->roi) {
+        const size_t *rect = job->roi_rect;
+        if (rect[0] >= job->out_width || rect[2] > job->out_width - rect[0] ||
+            rect[1] >= job->out_height || rect[3] > job->out_height - rect[1]) {
+            fprintf(stderr, "Error: Das Fenster liegt nicht vollständig im Ausgabebild (%lu x %lu).\n",
+                    job->out_width, job->out_height);
+            print_usage(progname);
+            return -1;
+        }
+        filter_source_rows(height, job->scalFac, job->filter, rect[1], rect[3], &job->first_row, &job->row_count);
+        job->out_width = rect[2];
+        job->out_height = rect[3];
+        if (pnm_skip_rows(&job->reader, job->first_row) != 0) {
+            fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return -1;
+        }
     }
-    // printf("%ld %ld\n", width, height);
 
     // 9. Image data
     // Check for overflow
-    if ((width != 0 && height > UINT64_MAX / width) || ((width * height) != 0 && 3 > UINT64_MAX / (width * height))) {
+    if ((width != 0 && height > UINT64_MAX / width) ||
+        ((width * height) != 0 && job->channels > UINT64_MAX / (width * height))) {
         fprintf(stderr, "Error: Länge des Eingabebildes generiert Overflow.\n");
         print_usage(progname);
-        return EXIT_FAILURE;
+        return -1;
     }
-    size_t imglen = (width * height * 3);
-    uint8_t *img = malloc(imglen);
-    if(img == NULL) {
+    size_t imglen = (width * job->row_count * job->channels);
+    job->img = malloc(imglen);
+    if (job->img == NULL) {
         fprintf(stderr, "Error: Speicherallokation für das Eingabebild hat nicht funktioniert.\n");
         print_usage(progname);
-        return EXIT_FAILURE;
+        return -1;
+    }
+    // Every tile reads source rows, the workers of all nodes share them
+    if (job->numa != NUMA_OFF) {
+        numa_interleave(&job->topo, job->img, imglen);
+    }
+    switch (pnm_read_rows(&job->reader, job->row_count, job->img)) {
+        case 0:
+            break;
+        case PNM_ERR_DATA:
+            fprintf(stderr, "Error: Die Bilddaten der Eingabedatei sind ungültig.\n");
+            print_usage(progname);
+            return -1;
+        default:
+            fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return -1;
+    }
+
+    // Close input file
+    pnm_reader_free(&job->reader);
+    fclose(job->instream);
+    if (job->counters) {
+        perf_end(&job->pc, &job->stages[STAGE_READ]);
+    }
+    trace_end("Einlesen", -1, job->trace_read);
+    return 0;
+}
+
+/**
+ * This function updates an existing output incrementally (--update, --dirty):
+ * only the quads of changed source blocks are written into the old output.
+ * @param job Job with the image that was read
+ * @return Exit code
+ */
+static int run_update(struct job *job) {
+    const char *progname = job->progname;
+    size_t width = job->header.width;
+    size_t height = job->header.height;
+    uint8_t *gray = job->img;
+    if (job->channels != 1) {
+        gray = malloc(width * height);
+        if (gray == NULL) {
+            fprintf(stderr, "Error: Speicherallokation für Zwischenergebnisse hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        grayscale(job->img, gray, width, height, job->coeffs[0], job->coeffs[1], job->coeffs[2]);
     }
-    if (fread(img, sizeof(char), imglen, instream) == 0) {
-        fprintf(stderr, "Error: Lesen von der Eingabedatei hat nicht funktioniert.\n");
+    uint8_t *old = NULL;
+    int err = job->update_prev ? update_load(job->update_prev, width, height, job->coeffs, &old) : 0;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", job->outname, job->ext);
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
+    struct update_stats ustats;
+    if (err == 0) {
+        err = update(path, gray, old, width, height, job->scalFac, job->dirty_rects, job->ndirty, &ustats);
+    }
+    clock_gettime(1, &end);
+    switch (err) {
+        case 0:
+            break;
+        case UPDATE_ERR_OPEN:
+            fprintf(stderr, "Error: Das vorherige Eingabebild oder die Ausgabedatei konnte nicht geöffnet werden.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case UPDATE_ERR_HEADER:
+            fprintf(stderr, "Error: Das vorherige Eingabebild oder die Ausgabedatei passt nicht zum Eingabebild und Skalierungsfaktor.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case UPDATE_ERR_MEMORY:
+            fprintf(stderr, "Error: Speicherallokation für Zwischenergebnisse hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        case UPDATE_ERR_READ:
+            fprintf(stderr, "Error: Lesen des vorherigen Eingabebildes hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        default:
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+    }
+    if (gray != job->img) {
+        free(gray);
+    }
+    free(old);
+    free(job->img);
+
+    fprintf(stdout, "===========================================\n");
+    fprintf(stdout, "Ergebnisse:\n");
+    fprintf(stdout, "Geänderte Blöcke: %lu von %lu\n", ustats.dirty, ustats.blocks);
+    fprintf(stdout, "Neu berechnete Pixel: %lu von %lu\n", ustats.pixels, job->out_width * job->out_height);
+    if (job->perf) {
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        fprintf(stdout, "Laufzeit: %f Sekunden\n", time);
+    }
+    fprintf(stdout, "Ausgabe in: %s\n", path);
+    fprintf(stdout, "===========================================\n");
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function writes the tiles of all scaling factors into the tile cache
+ * (--pyramid). All levels share the read and the grayscale pass.
+ * @param job Job with the image that was read
+ * @return Exit code
+ */
+static int run_pyramid(struct job *job) {
+    const char *progname = job->progname;
+    size_t width = job->header.width;
+    size_t height = job->header.height;
+    uint8_t *gray = (job->channels == 1) ? job->img : malloc(width * height);
+    if (gray == NULL) {
+        fprintf(stderr, "Error: Speicherallokation für Zwischenergebnisse hat nicht funktioniert.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
-    // Check for whitespace in the beginning since there can only be 1 whitespace between maxval and rbgs
-    if (isspace(img[0]) != 0) {
-        fprintf(stderr, "Error: Es darf maximal nur ein Whitespace nach dem maximalen Wert in der Eingabedatei sein.\n");
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
+    uint64_t t = trace_begin();
+    if (job->channels != 1) {
+        grayscale(job->img, gray, width, height, job->coeffs[0], job->coeffs[1], job->coeffs[2]);
+    }
+    trace_end("Graustufen", -1, t);
+    t = trace_begin();
+    struct pyramid_stats stats;
+    if (pyramid(gray, width, height, job->factors, job->nfactors, job->tile, job->pyramid_dir, &stats) != 0) {
+        fprintf(stderr, "Error: Schreiben in den Kachel-Cache hat nicht funktioniert.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
+    trace_end("Pyramide", -1, t);
+    clock_gettime(1, &end);
+    if (gray != job->img) {
+        free(gray);
+    }
+    free(job->img);
 
-    // Close input file
-    fclose(instream);
+    fprintf(stdout, "===========================================\n");
+    fprintf(stdout, "Ergebnisse:\n");
+    fprintf(stdout, "Kacheln: %lu geschrieben, %lu aus dem Cache\n", stats.written, stats.skipped);
+    if (job->perf) {
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        fprintf(stdout, "Laufzeit: %f Sekunden\n", time);
+    }
+    fprintf(stdout, "Ausgabe in: %s/%016lx/%lu\n", job->pyramid_dir, stats.key, job->tile);
+    fprintf(stdout, "===========================================\n");
+    return EXIT_SUCCESS;
+}
 
-    // Create provisional tmp var
-    // Check for overflow
-    if ((width != 0 && scalFac > UINT64_MAX / width) || 
-    (height != 0 && scalFac > UINT64_MAX / height) ||
-    ((width * scalFac) != 0 && (height * scalFac) > UINT64_MAX / (width * scalFac))
-    ) {
-        fprintf(stderr, "Error: Länge des Ausgabebildes generiert Overflow.\n");
+/**
+ * This function computes the key of the result cache from the hash of the
+ * samples and the parameters that change the output.
+ * @param job Job with the image that was read
+ * @return Key of the result cache
+ */
+static uint64_t job_cache_key(const struct job *job) {
+    uint32_t coeff_bits[3];
+    memcpy(coeff_bits, job->coeffs, sizeof(coeff_bits));
+    // Exact and filter kernels give the output of V0 or of their filter, so the key depends on the precision and
+    // the filter and not on -V or the profile (fast kernels set job->fast)
+    int precision = job->fast ? KERNEL_FAST : KERNEL_EXACT;
+    uint64_t params[] = {
+        job->header.width, job->header.height, job->channels, job->header.maxval, job->scalFac, precision,
+        job->color, job->ascii, job->filter, job->layout, job->roi,
+        job->roi_rect[0], job->roi_rect[1], job->roi_rect[2], job->roi_rect[3],
+        coeff_bits[0], coeff_bits[1], coeff_bits[2],
+    };
+    return cache_key(job->reader.hash, params, sizeof(params) / sizeof(params[0]));
+}
+
+/**
+ * This function prints the results of the whole-image modes.
+ * @param job Job that was run
+ * @param placement Pinning of the workers (--numa)
+ * @param avgtime Average runtime of the kernel (-B)
+ * @param kernel_times Average runtime per kernel, -1 if it was not run (-V all), NULL otherwise
+ * @param cache_key_value Key of the result in the cache (--cache)
+ * @param outpath Path of the output file
+ */
+static void print_results(const struct job *job, const struct numa_job *placement, double avgtime,
+                          const double *kernel_times, uint64_t cache_key_value, const char *outpath) {
+    fprintf(stdout, "===========================================\n");
+    fprintf(stdout, "Ergebnisse:\n");
+    if (!job->impl_all) {
+        fprintf(stdout, "Version: %ld (%s%s)\n", job->impl, kernels[job->impl].name,
+                job->tuned && !job->fast ? ", auto" : "");
+    }
+    if (job->filter != FILTER_BILINEAR) {
+        fprintf(stdout, "Filter: %s\n", job->filter == FILTER_BICUBIC ? "bicubic" : "lanczos");
+    }
+    if (job->layout) {
+        fprintf(stdout, "Layout: Kacheln mit %lu x %lu Pixeln\n", job->layout, job->layout);
+    }
+    if (job->threads > 1) {
+        fprintf(stdout, "Threads: %lu\n", job->threads);
+    }
+    if (job->numa != NUMA_OFF) {
+        fprintf(stdout, "NUMA: %lu Knoten, Threads gepinnt auf %s\n", job->topo.nnodes,
+                job->numa == NUMA_CORES ? "CPUs" : "Knoten");
+        for (size_t w = 0; w < job->threads; w++) {
+            if (placement->place[w].cpu >= 0) {
+                fprintf(stdout, "  Thread %lu: Knoten %d, CPU %d\n", w, placement->place[w].node, placement->place[w].cpu);
+            }
+            else {
+                fprintf(stdout, "  Thread %lu: Knoten %d, alle CPUs des Knotens\n", w, placement->place[w].node);
+            }
+        }
+    }
+    if (job->max_memory) {
+        print_plan(stdout, &job->plan, job->max_memory);
+    }
+    if (job->perf) {
+        fprintf(stdout, "Performanz Wiederholungen: %lu\n", job->loops);
+    }
+    if (job->impl_all) {
+        // Relative to the reference, which supports every factor
+        fprintf(stdout, "Durschnittliche Laufzeit je Implementierung:\n");
+        for (size_t k = 0; k < nkernels; k++) {
+            if (kernel_times[k] < 0) {
+                fprintf(stdout, "  V%lu %-10s nicht unterstützt\n", k, kernels[k].name);
+            }
+            else {
+                fprintf(stdout, "  V%lu %-10s %f Sekunden (%.2fx)\n", k, kernels[k].name, kernel_times[k],
+                        kernel_times[0] / kernel_times[k]);
+            }
+        }
+    }
+    else if (job->perf) {
+        fprintf(stdout, "Durschnittliche Laufzeit: %f Sekunden\n", avgtime);
+    }
+    if (job->counters) {
+        perf_report(stdout, &job->pc, job->stages, STAGES, (double)(job->out_width * job->out_height) / 1e6);
+    }
+    if (job->cache_dir) {
+        fprintf(stdout, "Cache: gespeichert (%s/%016lx%s)\n", job->cache_dir, cache_key_value, job->ext);
+    }
+    fprintf(stdout, "Ausgabe in: %s\n", outpath);
+    fprintf(stdout, "===========================================\n");
+}
+
+/**
+ * This function interpolates the image into one output buffer (or the mapped
+ * output file) and writes it, optionally through the result cache.
+ * @param job Job with the image that was read
+ * @return Exit code
+ */
+static int run_full(struct job *job) {
+    const char *progname = job->progname;
+    size_t width = job->header.width;
+    size_t height = job->header.height;
+    size_t scalFac = job->scalFac;
+    size_t impl = job->impl;
+    size_t layout = job->layout;
+    size_t out_width = job->out_width;
+    size_t out_height = job->out_height;
+    size_t out_channels = job->out_channels;
+    const char *ext = job->ext;
+    const size_t *rect = job->roi ? job->roi_rect : NULL;
+    const struct perf_counters *pc = job->counters ? &job->pc : NULL;
+
+    // -V all runs every kernel on the same whole grayscale image with one thread
+    double *kernel_times = NULL;
+    if (job->impl_all) {
+        kernel_times = malloc(nkernels * sizeof(double));
+        if (!kernel_times) {
+            fprintf(stderr, "Error: Speicherallokation für die Messungen hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Result cache: the same samples with the same parameters give the same output
+    uint64_t cache_key_value = 0;
+    // Path of the output file, the argument of -o is not written to
+    char outpath[PATH_MAX];
+    snprintf(outpath, sizeof(outpath), "%s%s", job->outname, ext);
+    if (job->cache_dir) {
+        cache_key_value = job_cache_key(job);
+        int hit = cache_fetch(job->cache_dir, cache_key_value, ext, outpath);
+        if (hit < 0) {
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        if (hit) {
+            free(job->img);
+            fprintf(stdout, "===========================================\n");
+            fprintf(stdout, "Ergebnisse:\n");
+            fprintf(stdout, "Cache: Treffer (%s/%016lx%s)\n", job->cache_dir, cache_key_value, ext);
+            fprintf(stdout, "Ausgabe in: %s\n", outpath);
+            fprintf(stdout, "===========================================\n");
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // Open output file
+    // A shared writable mapping needs read access to the file as well
+    int outfd = open(outpath, O_CREAT | (job->use_mmap ? O_RDWR : O_WRONLY) | O_TRUNC, S_IRWXU);
+    if (outfd < 0) {
+        fprintf(stderr, "Error: Fehler beim erstellen der Ausgabedatei.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
-    size_t reslen = (width * scalFac) * (height * scalFac);
-    uint8_t *tmp = malloc(reslen);
+
+    // Create provisional tmp var
+    // The tiled layout stores every tile in a page-aligned slot
+    size_t reslen = layout ? layout_data_size(out_width, out_height, layout, out_channels)
+                           : out_width * out_height * out_channels;
+    // Grayscale copy (or color planes) of the source rows that were read
+    uint8_t *tmp = malloc(width * job->row_count * out_channels);
     if(tmp == NULL) {
         fprintf(stderr, "Error: Speicherallokation für Zwischenergebnisse hat nicht funktioniert.\n");
         print_usage(progname);
         return EXIT_FAILURE;
     }
+    if (job->numa != NUMA_OFF) {
+        numa_interleave(&job->topo, tmp, width * job->row_count * out_channels);
+    }
+
+    // Header of the output file
+    // The tiled layout starts with its own header and the index of the tiles
+    char pnm_metadata[METADATA_MAX];
+    char *metadata = pnm_metadata;
+    size_t metalen;
+    if (layout) {
+        // The header stores the sizes in 32 bit fields
+        if (out_width > UINT32_MAX || out_height > UINT32_MAX) {
+            fprintf(stderr, "Error: --layout tiles unterstützt nur Ausgabebilder mit höchstens %u x %u Pixeln.\n",
+                    UINT32_MAX, UINT32_MAX);
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        metadata = malloc(layout_size(out_width, out_height, layout));
+        if (metadata == NULL) {
+            fprintf(stderr, "Error: Speicherallokation für Zwischenergebnisse hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        metalen = layout_header((uint8_t *)metadata, out_width, out_height, layout, out_channels, job->out_maxval);
+    }
+    else {
+        metalen = create_metadata(metadata, job->ascii, out_channels, job->out_maxval, out_width, out_height);
+    }
 
     // Create buffer for result
-    uint8_t *result = malloc(reslen);
-    if(result == NULL) {
-        fprintf(stderr, "Error: Speicherallokation für das Ausgabebild hat nicht funktioniert.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+    uint8_t *result;
+    uint8_t *map = NULL;
+    size_t maplen = metalen + reslen;
+    if (job->use_mmap) {
+        // Size the file to header + payload and let the kernel write straight into the page cache
+        if (ftruncate(outfd, maplen) != 0) {
+            fprintf(stderr, "Error: Vergrößern der Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, outfd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Error: Mappen der Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        memcpy(map, metadata, metalen);
+        result = map + metalen;
+    }
+    else {
+        // The padding of the tile slots is written as zeros
+        result = layout ? calloc(reslen, 1) : malloc(reslen);
+        if(result == NULL) {
+            fprintf(stderr, "Error: Speicherallokation für das Ausgabebild hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Workers for the tiles, the threads are started once for all repetitions
+    struct pool pool_storage;
+    struct pool *pool = NULL;
+    struct numa_job placement = { .topo = &job->topo, .mode = job->numa, .failed = 0 };
+    if (job->use_pool) {
+        if (pool_create(&pool_storage, job->threads) != 0) {
+            fprintf(stderr, "Error: Starten der Threads hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        pool = &pool_storage;
+    }
+    if (job->numa != NUMA_OFF) {
+        // Pin the workers, then every worker touches the output rows of its first block of tiles
+        pool_each(pool, pin_task, &placement);
+        if (placement.failed) {
+            fprintf(stderr, "Error: Pinnen der Threads hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        interpolate_tiles_touch(pool, rect, width, height, scalFac, layout, result);
+    }
+    if (pc && pool) {
+        // The counters only count their own thread, every worker adds its own set
+        pool_each(pool, perf_task, &job->pc);
     }
 
     // Call function for interpolation
-    double avgtime;
-    if (perf) {
-        // Performance testing is on
-        struct timespec start;
-        struct timespec end;
-        switch (impl) {
-            case 1:
-                clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
-                for (size_t i = 0; i < loops; ++i) {
-                    interpolate_V1(img, width, height, coeffs[0], coeffs[1], coeffs[2], scalFac, tmp, result);
-                }
-                clock_gettime(1, &end);
-                break;
-            default: // case 0:
-                clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
-                for (size_t i = 0; i < loops; ++i) {
-                    interpolate(img, width, height, coeffs[0], coeffs[1], coeffs[2], scalFac, tmp, result);
-                }
-                clock_gettime(1, &end);
-                break;
+    double avgtime = 0;
+    if (job->perf) {
+        // Performance testing is on, -V all measures every kernel and the reference last, its output is written
+        bool all = job->impl_all;
+        for (size_t k = all ? nkernels : impl + 1; k-- > (all ? 0 : impl);) {
+            if (all && !kernel_supports(&kernels[k], scalFac)) {
+                kernel_times[k] = -1;
+                continue;
+            }
+            struct timespec start;
+            struct timespec end;
+            clock_gettime(1, &start); // 1 expands to CLOCK_MONOTONIC
+            for (size_t i = 0; i < job->loops; ++i) {
+                uint64_t t = trace_begin();
+                run_interpolation(k, job->color, job->fast, job->filter, layout, rect, job->channels, job->img,
+                                  job->first_row, width, height, job->coeffs, scalFac, tmp, result, pc, job->stages,
+                                  pool);
+                trace_end("Interpolation", -1, t);
+            }
+            clock_gettime(1, &end);
+            double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+            avgtime = time / job->loops;
+            if (all) {
+                kernel_times[k] = avgtime;
+            }
         }
-        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
-        avgtime = time / loops;
     }
     else {
-        switch (impl) {
-            case 1:
-                interpolate_V1(img, width, height, coeffs[0], coeffs[1], coeffs[2], scalFac, tmp, result);
-                break;
-            default: // case 0:
-                interpolate(img, width, height, coeffs[0], coeffs[1], coeffs[2], scalFac, tmp, result);
-                break;
-        }
+        uint64_t t = trace_begin();
+        run_interpolation(impl, job->color, job->fast, job->filter, layout, rect, job->channels, job->img,
+                          job->first_row, width, height, job->coeffs, scalFac, tmp, result, NULL, NULL, pool);
+        trace_end("Interpolation", -1, t);
     }
 
     // Write result into output file
-    // Get length of width and height
-    size_t nw = width * scalFac;
-    size_t nh = height * scalFac;
-    short wl = 0;
-    short hl = 0;
-    while (nw > 0) {
-        nw /= 10;
-        wl++;
-    }
-    while (nh > 0) {
-        nh /= 10;
-        hl++;
-    }
-    char w[wl];
-    char h[hl];
-
-    // Funny comment to add
-    char *fun = "# Emir, Lukas and Benji are cool!\n";
-    char metadata[3 + strlen(fun) + wl + 1 + hl + 5];
-
-    for (uint8_t i = 0; i < sizeof(metadata); i++) {
-        metadata[i] = '\x00';
-    }
-
-    sprintf(w, "%lu", width * scalFac);
-    sprintf(h, "%lu", height * scalFac);
-
-    strcat(metadata, "P5\n");
-    strcat(metadata, fun);
-    strcat(metadata, w);
-    strcat(metadata, " ");
-    strcat(metadata, h);
-    strcat(metadata, "\n255\n");
-
-    if (write(outfd, metadata, sizeof(metadata)) < 0) {
-        fprintf(stderr, "Error: Metadaten in die Ausgabedatei zu schreiben hat nicht funktioniert.\n");
-        print_usage(progname);
-        return EXIT_FAILURE;
+    if (pc) {
+        perf_begin(pc, &job->stages[STAGE_WRITE]);
     }
+    uint64_t trace_write = trace_begin();
+    if (job->use_mmap) {
+        // The payload is already in the mapping, dirty pages are flushed asynchronously
+        munmap(map, maplen);
+        close(outfd);
+    }
+    else {
+        if (write(outfd, metadata, metalen) < 0) {
+            fprintf(stderr, "Error: Metadaten in die Ausgabedatei zu schreiben hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
 
-    // Format result data
-    FILE *outstream = fdopen(outfd, "wb");
-    fwrite(result, sizeof(char), (width * scalFac) * (height * scalFac), outstream);
+        // Format result data
+        FILE *outstream = fdopen(outfd, "wb");
+        struct pnm_cache outcache;
+        // --cache copies the output right after it was written, its pages are kept for that
+        pnm_cache_open(&outcache, outstream, false, !job->cache_dir);
+        // The tiled layout is written slot by slot
+        size_t row_len = layout ? layout_offset(layout, out_channels, 1) : out_width * out_channels;
+        if (pnm_write_cached(&outcache, outstream, result, row_len, reslen / row_len, job->ascii) != 0) {
+            fprintf(stderr, "Error: Schreiben in die Ausgabedatei hat nicht funktioniert.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
 
-    // Close output file stream
-    fclose(outstream);
-    close(outfd);
+        // Close output file stream
+        fclose(outstream);
+        free(result);
+    }
+    if (pc) {
+        perf_end(pc, &job->stages[STAGE_WRITE]);
+    }
+    trace_end("Schreiben", -1, trace_write);
+    if (job->cache_dir && cache_store(job->cache_dir, cache_key_value, ext, outpath) != 0) {
+        fprintf(stderr, "Warnung: Das Ergebnis konnte nicht im Cache gespeichert werden.\n");
+    }
 
     // Free resources
-    free(img);
+    free(job->img);
     free(tmp);
-    free(result);
+    if (metadata != pnm_metadata) {
+        free(metadata);
+    }
+    if (pool) {
+        pool_destroy(pool);
+    }
 
     // Display metrics
-    fprintf(stdout, "===========================================\n");
-    fprintf(stdout, "Ergebnisse:\n");
-    fprintf(stdout, "Version: %ld\n", impl);
-    if (perf) {
-        fprintf(stdout, "Performanz Wiederholungen: %lu\n", loops);
-        fprintf(stdout, "Durschnittliche Laufzeit: %f Sekunden\n", avgtime);
+    print_results(job, &placement, avgtime, kernel_times, cache_key_value, outpath);
+    free(kernel_times);
+    if (job->counters) {
+        perf_close(&job->pc);
     }
-    fprintf(stdout, "Ausgabe in: %s\n", outname);
-    fprintf(stdout, "===========================================\n");
 
     // Exit with success if everything worked fine
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief This is the starting point of the program.
+ * @param argc argument count
+ * @param argv[] array of arguments
+ */
+int main(int argc, char *argv[]) {
+    const char *progname = argv[0];
+
+    // If the argument count is one, there's no argument passed since the name of
+    // the program itself is argument one.
+    if (argc == 1) {
+        print_usage(progname);
+        // Prettier for return 1 alias failure
+        return EXIT_FAILURE;
+    }
+
+    // The job is large (paths, profile, topology), it lives as long as the process
+    static struct job job;
+    int ret = parse_options(&job, argc, argv);
+    if (ret != OPTIONS_RUN) {
+        return ret;
+    }
+    if (job.serve_path) {
+        return run_serve(&job);
+    }
+    if (select_kernel(&job) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (!job.profile_path && tune_default_path(job.default_profile, sizeof(job.default_profile)) == 0) {
+        job.profile_path = job.default_profile;
+    }
+    if (job.tune) {
+        return run_tune(&job);
+    }
+
+    // Positional argument, "-" reads the image from stdin
+    job.instream = (strcmp(job.inpath, "-") == 0) ? stdin : fopen(job.inpath, "r");
+    if (job.instream == NULL) {
+        fprintf(stderr, "Error: Fehler beim Öffnen der Eingabedatei.\n");
+        print_usage(progname);
+        return EXIT_FAILURE;
+    }
+
+    // Check for enough optional arguments
+    if (job.scalFac == 0 || (!job.outname && !job.pyramid_dir)) {
+        fprintf(stderr, "Error: Skalierungsfaktor oder Ausgabedatei wurde nicht angegeben.\n");
+        print_usage(progname);
+        return EXIT_FAILURE;
+    }
+    job.to_stdout = job.outname && strcmp(job.outname, "-") == 0;
+    unsigned flags = option_flags(&job);
+    if (check_conflicts(flags, progname) != 0) {
+        return EXIT_FAILURE;
+    }
+    job.layout = job.tiled ? job.tile : 0;
+    job.updating = job.update_prev || job.ndirty > 0;
+    // Pipes and several factors are processed row by row with constant memory
+    job.stream = !job.pyramid_dir && !job.roi && !job.use_mmap &&
+                 (job.instream == stdin || job.to_stdout || job.nfactors > 1);
+
+    if (job.trace_path && trace_start(job.trace_path) != 0) {
+        fprintf(stderr, "Error: Fehler beim erstellen der Trace-Datei.\n");
+        print_usage(progname);
+        return EXIT_FAILURE;
+    }
+    job.trace_read = trace_begin();
+    if (job.counters) {
+        perf_open(&job.pc);
+        perf_begin(&job.pc, &job.stages[STAGE_READ]);
+    }
+
+    if (read_header(&job) != 0) {
+        return EXIT_FAILURE;
+    }
+    flags |= job.deep ? OPT_DEEP : 0;
+    if (check_conflicts(flags, progname) != 0) {
+        return EXIT_FAILURE;
+    }
+    job.stream = job.stream || job.deep;
+    if (job.frames) {
+        return run_frames(&job);
+    }
+
+    load_profile(&job);
+    // Memory budget: one output buffer if it fits, otherwise streaming in bands that fit
+    if (job.max_memory) {
+        bool can_stream = !job.roi && !job.use_mmap && !job.pyramid_dir && !job.cache_dir && !job.updating &&
+                          !job.tiled && job.filter == FILTER_BILINEAR;
+        if (plan_memory(job.max_memory, job.header.width, job.header.height, job.channels, job.out_channels,
+                        pnm_sample_bytes(&job.header), job.factors, job.nfactors, job.roi ? job.roi_rect : NULL,
+                        job.threads, can_stream, job.stream, &job.plan) != 0) {
+            fprintf(stderr, "Error: Das Speicherbudget von %lu Bytes reicht für das Bild nicht aus (geschätzt %lu Bytes ohne Streaming).\n",
+                    job.max_memory, job.plan.full_bytes);
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+        job.stream = job.plan.stream;
+        job.threads = job.plan.threads;
+    }
+    // --numa and the tiled layout run on the pool as well, with a single worker it is the main thread
+    job.use_pool = job.threads > 1 || job.numa != NUMA_OFF || job.tiled;
+    flags |= job.stream ? OPT_STREAM : OPT_BUFFER;
+    flags |= job.use_pool ? OPT_POOL : 0;
+    if (check_conflicts(flags, progname) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // The topology is needed before the buffers are allocated
+    if (job.numa != NUMA_OFF && numa_topology_read(&job.topo) != 0) {
+        fprintf(stderr, "Error: Die CPUs des Prozesses konnten nicht bestimmt werden.\n");
+        print_usage(progname);
+        return EXIT_FAILURE;
+    }
+    job.ext = job.tiled ? ".tiles" : job.color ? ".ppm" : ".pgm";
+    if (pnm_reader_init(&job.reader, job.instream, &job.header) != 0) {
+        fprintf(stderr, "Error: Speicherallokation für das Eingabebild hat nicht funktioniert.\n");
+        print_usage(progname);
+        return EXIT_FAILURE;
+    }
+    // The key of the result cache is hashed while the rows are read
+    if (job.cache_dir) {
+        pnm_reader_hash(&job.reader, HASH_INIT);
+    }
+
+    // Check every scaling factor for overflow
+    for (size_t k = 0; k < job.nfactors; k++) {
+        if (check_output_size(&job, job.factors[k]) != 0) {
+            fprintf(stderr, "Error: Länge des Ausgabebildes generiert Overflow.\n");
+            print_usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Streaming: the rows are interpolated while the input is still arriving
+    if (job.stream) {
+        return run_stream(&job);
+    }
+    if (read_image(&job) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (job.updating) {
+        return run_update(&job);
+    }
+    if (job.pyramid_dir) {
+        return run_pyramid(&job);
+    }
+    return run_full(&job);
+}
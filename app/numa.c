@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "numa.h"
+
+// Memory policy of the mbind system call (linux/mempolicy.h)
+#define MPOL_INTERLEAVE 3
+
+/**
+ * This function parses a list of ranges like "0-3,8,10-11" and calls add for
+ * every number.
+ * @param list List
+ * @param add Callback
+ * @param ctx Context for add
+ */
+static void parse_list(const char *list, void (*add)(void *ctx, int n), void *ctx) {
+    const char *p = list;
+    while (*p >= '0' && *p <= '9') {
+        char *endp;
+        long first = strtol(p, &endp, 10);
+        long last = first;
+        if (*endp == '-') {
+            last = strtol(endp + 1, &endp, 10);
+        }
+        for (long n = first; n <= last; n++) {
+            add(ctx, (int)n);
+        }
+        p = (*endp == ',') ? endp + 1 : endp;
+    }
+}
+
+/**
+ * This function reads the first line of a sysfs file.
+ * @param path Path of the file
+ * @param line Buffer
+ * @param len Length of the buffer
+ * @return 0 on success, -1 otherwise
+ */
+static int read_line(const char *path, char *line, size_t len) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char *ret = fgets(line, (int)len, file);
+    fclose(file);
+    return ret == NULL ? -1 : 0;
+}
+
+/**
+ * Context of add_cpu and add_node
+ * @param topo Topology
+ * @param allowed Affinity mask of the process
+ */
+struct parse_ctx {
+    struct numa_topology *topo;
+    const cpu_set_t *allowed;
+};
+
+/**
+ * This function adds a CPU to the node that is currently parsed, if the
+ * process may run on it.
+ * @param ctx Context (struct parse_ctx)
+ * @param cpu CPU
+ */
+static void add_cpu(void *ctx, int cpu) {
+    struct parse_ctx *pc = ctx;
+    struct numa_topology *topo = pc->topo;
+    size_t k = topo->nnodes;
+    if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, pc->allowed) && topo->ncpus[k] < NUMA_MAX_CPUS) {
+        topo->cpus[k][topo->ncpus[k]++] = cpu;
+    }
+}
+
+/**
+ * This function adds a node and its usable CPUs to the topology.
+ * @param ctx Context (struct parse_ctx)
+ * @param node Node id
+ */
+static void add_node(void *ctx, int node) {
+    struct parse_ctx *pc = ctx;
+    struct numa_topology *topo = pc->topo;
+    if (topo->nnodes == NUMA_MAX_NODES || node >= NUMA_MAX_NODES) {
+        return;
+    }
+    char path[64];
+    char line[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if (read_line(path, line, sizeof(line)) != 0) {
+        return;
+    }
+    topo->node[topo->nnodes] = node;
+    topo->ncpus[topo->nnodes] = 0;
+    parse_list(line, add_cpu, pc);
+    // Nodes without usable CPUs (memory only) get no workers
+    if (topo->ncpus[topo->nnodes] > 0) {
+        topo->nnodes++;
+    }
+}
+
+int numa_topology_read(struct numa_topology *topo) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+    topo->nnodes = 0;
+    struct parse_ctx pc = { topo, &allowed };
+    char line[4096];
+    if (read_line("/sys/devices/system/node/online", line, sizeof(line)) == 0) {
+        parse_list(line, add_node, &pc);
+    }
+    if (topo->nnodes > 0) {
+        return 0;
+    }
+
+    // No NUMA information: one node with all CPUs of the process
+    topo->nnodes = 1;
+    topo->node[0] = 0;
+    topo->ncpus[0] = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && topo->ncpus[0] < NUMA_MAX_CPUS; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            topo->cpus[0][topo->ncpus[0]++] = cpu;
+        }
+    }
+    return topo->ncpus[0] > 0 ? 0 : -1;
+}
+
+int numa_pin(const struct numa_topology *topo, int mode, size_t worker, struct numa_place *place) {
+    size_t k = worker % topo->nnodes;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    place->node = topo->node[k];
+    if (mode == NUMA_CORES) {
+        place->cpu = topo->cpus[k][(worker / topo->nnodes) % topo->ncpus[k]];
+        CPU_SET(place->cpu, &set);
+    }
+    else {
+        place->cpu = -1;
+        for (size_t c = 0; c < topo->ncpus[k]; c++) {
+            CPU_SET(topo->cpus[k][c], &set);
+        }
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+void numa_interleave(const struct numa_topology *topo, void *buf, size_t len) {
+    if (topo->nnodes < 2) {
+        return;
+    }
+    // mbind works on whole pages, the partial pages at both ends keep the default policy
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)buf + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)buf + len) / page * page;
+    if (end <= first) {
+        return;
+    }
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+    memset(mask, 0, sizeof(mask));
+    for (size_t k = 0; k < topo->nnodes; k++) {
+        mask[topo->node[k] / (8 * sizeof(unsigned long))] |= 1UL << (topo->node[k] % (8 * sizeof(unsigned long)));
+    }
+    // Best effort: without NUMA support in the kernel the pages simply stay where they are
+    syscall(SYS_mbind, (void *)first, end - first, MPOL_INTERLEAVE, mask, 8 * sizeof(mask), 0);
+}
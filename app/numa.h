@@ -0,0 +1,66 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+// Upper bounds for the topology
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 256
+
+// Placement modes of --numa
+#define NUMA_OFF 0      // No pinning, no first touch
+#define NUMA_CORES 1    // Every worker is pinned to one CPU
+#define NUMA_NODES 2    // Every worker is pinned to the CPUs of one node
+
+/**
+ * NUMA nodes and the CPUs the process may run on
+ * @param nnodes Number of nodes with at least one usable CPU
+ * @param node Node ids
+ * @param ncpus Number of usable CPUs per node
+ * @param cpus Usable CPUs per node
+ */
+struct numa_topology {
+    size_t nnodes;
+    int node[NUMA_MAX_NODES];
+    size_t ncpus[NUMA_MAX_NODES];
+    int cpus[NUMA_MAX_NODES][NUMA_MAX_CPUS];
+};
+
+/**
+ * Placement of a worker
+ * @param node Node id
+ * @param cpu CPU the worker is pinned to, -1 if it may run on all CPUs of the node
+ */
+struct numa_place {
+    int node;
+    int cpu;
+};
+
+/**
+ * This function reads the nodes and their CPUs from sysfs and keeps the CPUs
+ * of the affinity mask of the process. Without NUMA information (e.g. no
+ * sysfs) all CPUs form node 0.
+ * @param topo Topology
+ * @return 0 on success, -1 if no CPU could be determined
+ */
+int numa_topology_read(struct numa_topology *topo);
+
+/**
+ * This function pins the calling thread for worker number worker. The
+ * workers are spread round robin over the nodes, so the consecutive output
+ * bands of the workers alternate between the nodes as well.
+ * @param topo Topology
+ * @param mode NUMA_CORES or NUMA_NODES
+ * @param worker Index of the worker
+ * @param place Placement of the worker
+ * @return 0 on success, -1 if the affinity could not be set
+ */
+int numa_pin(const struct numa_topology *topo, int mode, size_t worker, struct numa_place *place);
+
+/**
+ * This function asks the kernel to interleave the pages of a buffer that is
+ * read by the workers of all nodes. The pages must not be touched before.
+ * Nothing happens on a single node.
+ * @param topo Topology
+ * @param buf Buffer
+ * @param len Length of the buffer in bytes
+ */
+void numa_interleave(const struct numa_topology *topo, void *buf, size_t len);
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf.h"
+
+// Cache event of perf_event_open: cache, operation and result
+#define CACHE_EVENT(cache, op, result) ((cache) | ((op) << 8) | ((result) << 16))
+
+/**
+ * Counter of the report
+ * @param name Column header
+ * @param type perf_event_attr.type
+ * @param config perf_event_attr.config
+ */
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[PERF_EVENTS] = {
+    {"Zyklen", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"Instruktionen", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D-Misses", PERF_TYPE_HW_CACHE,
+     CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"LLC-Misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"dTLB-Misses", PERF_TYPE_HW_CACHE,
+     CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"Branch-Misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"Page-Faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// Indices of the counters the IPC is computed from
+#define CYCLES 0
+#define INSTRUCTIONS 1
+
+/**
+ * This function opens the counters of the calling thread.
+ * @param fd One file descriptor per counter, -1 if the counter is not available
+ * @return Number of counters that could be opened
+ */
+static size_t open_counters(int *fd) {
+    size_t opened = 0;
+    for (size_t e = 0; e < PERF_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Every counter runs on its own, a group would fail completely if one of them is missing
+        fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd[e] >= 0) {
+            opened++;
+        }
+    }
+    return opened;
+}
+
+size_t perf_open(struct perf_counters *pc) {
+    pc->nthreads = 1;
+    return open_counters(pc->fd[0]);
+}
+
+void perf_open_thread(struct perf_counters *pc, size_t thread) {
+    open_counters(pc->fd[thread]);
+    // The stages only read the sets below nthreads
+    size_t n = __atomic_load_n(&pc->nthreads, __ATOMIC_RELAXED);
+    while (n < thread + 1 && !__atomic_compare_exchange_n(&pc->nthreads, &n, thread + 1, true, __ATOMIC_RELEASE,
+                                                           __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * This function reads the current values of all open counters.
+ * @param pc Counters
+ * @param values Values (0 for counters that are not open)
+ */
+static void read_counters(const struct perf_counters *pc, uint64_t *values) {
+    for (size_t e = 0; e < PERF_EVENTS; e++) {
+        values[e] = 0;
+        for (size_t t = 0; t < pc->nthreads; t++) {
+            uint64_t value;
+            if (pc->fd[t][e] >= 0 && read(pc->fd[t][e], &value, sizeof(uint64_t)) == sizeof(uint64_t)) {
+                values[e] += value;
+            }
+        }
+    }
+}
+
+void perf_begin(const struct perf_counters *pc, struct perf_stage *stage) {
+    clock_gettime(1, &stage->t0); // 1 expands to CLOCK_MONOTONIC
+    read_counters(pc, stage->start);
+}
+
+void perf_end(const struct perf_counters *pc, struct perf_stage *stage) {
+    uint64_t values[PERF_EVENTS];
+    read_counters(pc, values);
+    struct timespec t1;
+    clock_gettime(1, &t1);
+    for (size_t e = 0; e < PERF_EVENTS; e++) {
+        stage->value[e] += values[e] - stage->start[e];
+    }
+    stage->seconds += t1.tv_sec - stage->t0.tv_sec + 1e-9 * (t1.tv_nsec - stage->t0.tv_nsec);
+    stage->runs++;
+}
+
+void perf_report(FILE *out, const struct perf_counters *pc, const struct perf_stage *stages, size_t nstages,
+                 double megapixels) {
+    fprintf(out, "Zähler pro Durchlauf (in Klammern pro Megapixel der Ausgabe):\n");
+    for (size_t k = 0; k < nstages; k++) {
+        const struct perf_stage *stage = &stages[k];
+        if (stage->runs == 0) {
+            continue;
+        }
+        fprintf(out, "  %-14s %d x, %f Sekunden\n", stage->name, (int)stage->runs, stage->seconds / stage->runs);
+        for (size_t e = 0; e < PERF_EVENTS; e++) {
+            if (pc->fd[0][e] < 0) {
+                continue;
+            }
+            double value = (double)stage->value[e] / stage->runs;
+            fprintf(out, "    %-14s %16.0f (%.0f)\n", events[e].name, value, megapixels > 0 ? value / megapixels : 0);
+        }
+        if (pc->fd[0][CYCLES] >= 0 && pc->fd[0][INSTRUCTIONS] >= 0 && stage->value[CYCLES] > 0) {
+            fprintf(out, "    %-14s %16.2f\n", "IPC", (double)stage->value[INSTRUCTIONS] / stage->value[CYCLES]);
+        }
+    }
+    for (size_t e = 0; e < PERF_EVENTS; e++) {
+        if (pc->fd[0][e] < 0) {
+            fprintf(out, "  %s: nicht verfügbar\n", events[e].name);
+        }
+    }
+}
+
+void perf_close(struct perf_counters *pc) {
+    for (size_t t = 0; t < pc->nthreads; t++) {
+        for (size_t e = 0; e < PERF_EVENTS; e++) {
+            if (pc->fd[t][e] >= 0) {
+                close(pc->fd[t][e]);
+                pc->fd[t][e] = -1;
+            }
+        }
+    }
+}
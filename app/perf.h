@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Number of counters that are read for every stage
+#define PERF_EVENTS 7
+// Threads whose counters are summed, one per worker of the thread pool (POOL_MAX_WORKERS)
+#define PERF_THREADS 256
+
+/**
+ * Hardware counters of the process, opened with perf_event_open. A counter
+ * only counts the thread that opened it, so every worker of the thread pool
+ * opens its own set and the stages read the sum of all sets.
+ * @param nthreads Number of threads with a set of counters
+ * @param fd One file descriptor per thread and counter, -1 if the counter is not available
+ */
+struct perf_counters {
+    size_t nthreads;
+    int fd[PERF_THREADS][PERF_EVENTS];
+};
+
+/**
+ * Counters of one stage of the program (e.g. reading or interpolation),
+ * summed over all runs of the stage
+ * @param name Name of the stage in the report
+ * @param value Sum of every counter
+ * @param seconds Sum of the wall time
+ * @param runs Number of runs
+ * @param start Counter values at the begin of the current run
+ * @param t0 Time at the begin of the current run
+ */
+struct perf_stage {
+    const char *name;
+    uint64_t value[PERF_EVENTS];
+    double seconds;
+    size_t runs;
+    uint64_t start[PERF_EVENTS];
+    struct timespec t0;
+};
+
+/**
+ * This function opens the counters (cycles, instructions, L1 data cache
+ * misses, last level cache misses, dTLB misses, branch misses and page
+ * faults) for the calling thread, user space only. Counters that the CPU or
+ * the kernel doesn't provide (e.g. in a VM or with perf_event_paranoid > 2)
+ * are left out of the report.
+ * @param pc Counters
+ * @return Number of counters that could be opened
+ */
+size_t perf_open(struct perf_counters *pc);
+
+/**
+ * This function opens a set of counters for the calling thread, e.g. a worker
+ * of the thread pool, which is added to the counters of the stages from then
+ * on. Threads may call it at the same time for different indices.
+ * @param pc Counters, opened with perf_open
+ * @param thread Index of the set (1 .. PERF_THREADS - 1)
+ */
+void perf_open_thread(struct perf_counters *pc, size_t thread);
+
+/**
+ * This function starts a run of a stage.
+ * @param pc Counters
+ * @param stage Stage
+ */
+void perf_begin(const struct perf_counters *pc, struct perf_stage *stage);
+
+/**
+ * This function ends a run of a stage and adds the counted events to it.
+ * @param pc Counters
+ * @param stage Stage
+ */
+void perf_end(const struct perf_counters *pc, struct perf_stage *stage);
+
+/**
+ * This function prints the counters of all stages that ran at least once,
+ * per run and per megapixel of the output image, plus the IPC.
+ * @param out Output stream
+ * @param pc Counters
+ * @param stages Stages
+ * @param nstages Number of stages
+ * @param megapixels Size of the output image in megapixels
+ */
+void perf_report(FILE *out, const struct perf_counters *pc, const struct perf_stage *stages, size_t nstages,
+                 double megapixels);
+
+/**
+ * This function closes the counters.
+ * @param pc Counters
+ */
+void perf_close(struct perf_counters *pc);
@@ -0,0 +1,83 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/resource.h>
+#include "plan.h"
+
+size_t plan_stream_bytes(size_t width, size_t out_channels, size_t sample_bytes, const size_t *factors,
+                         size_t nfactors, size_t band_rows, size_t threads) {
+    size_t rowlen = width * out_channels * sample_bytes;
+    // One RGB row, the source rows of the band plus the first row of the next one
+    size_t bytes = PLAN_BASE + width * 3 * sample_bytes + (band_rows + 1) * rowlen;
+    // Color output splits two rows into planes on every thread
+    if (out_channels == 3) {
+        bytes += threads * 2 * rowlen;
+    }
+    for (size_t k = 0; k < nfactors; k++) {
+        bytes += band_rows * rowlen * factors[k] * factors[k];
+    }
+    return bytes;
+}
+
+int plan_memory(size_t budget, size_t width, size_t height, size_t channels, size_t out_channels,
+                size_t sample_bytes, const size_t *factors, size_t nfactors, const size_t *rect, size_t threads,
+                bool can_stream, bool must_stream, struct plan *plan) {
+    size_t s = factors[0];
+    // Source rows, their grayscale copy and the output buffer
+    size_t rows = height;
+    size_t out_len = width * s * height * s;
+    if (rect) {
+        rows = rect[3] / s + 2;
+        rows = (rows < height) ? rows : height;
+        out_len = rect[2] * rect[3];
+    }
+    plan->full_bytes = PLAN_BASE + width * rows * (channels + out_channels) + out_len * out_channels;
+
+    plan->threads = threads;
+    plan->band_rows = 0;
+    if (!must_stream && plan->full_bytes <= budget) {
+        plan->stream = false;
+        plan->bytes = plan->full_bytes;
+        return 0;
+    }
+    if (!can_stream && !must_stream) {
+        return -1;
+    }
+
+    plan->stream = true;
+    if (sample_bytes == 2) {
+        plan->threads = 1;
+        plan->band_rows = 1;
+        plan->bytes = plan_stream_bytes(width, out_channels, sample_bytes, factors, nfactors, 1, 1);
+        return (plan->bytes <= budget) ? 0 : -1;
+    }
+    // Enough rows for every thread and about PLAN_BAND_BYTES of output per thread
+    size_t row_bytes = plan_stream_bytes(width, out_channels, 1, factors, nfactors, 2, 1) -
+                       plan_stream_bytes(width, out_channels, 1, factors, nfactors, 1, 1);
+    size_t target = threads * PLAN_BAND_BYTES / row_bytes;
+    target = (target > threads) ? target : threads;
+    target = (target < height) ? target : height;
+    target = (target > 0) ? target : 1;
+    size_t band_rows = 0;
+    for (size_t b = 1; b <= target; b++) {
+        if (plan_stream_bytes(width, out_channels, 1, factors, nfactors, b, (threads < b) ? threads : b) > budget) {
+            break;
+        }
+        band_rows = b;
+    }
+    if (band_rows == 0) {
+        return -1;
+    }
+    plan->band_rows = band_rows;
+    plan->threads = (threads < band_rows) ? threads : band_rows;
+    plan->bytes = plan_stream_bytes(width, out_channels, 1, factors, nfactors, band_rows, plan->threads);
+    return 0;
+}
+
+size_t plan_peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    // ru_maxrss is given in KiB
+    return (size_t)usage.ru_maxrss * 1024;
+}
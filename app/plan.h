@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+// Memory of the process besides the image buffers (code, libc, stdio and reader buffers, stacks)
+#define PLAN_BASE (8ul << 20)
+// Band size per thread the planner aims for, larger bands only cost memory
+#define PLAN_BAND_BYTES (4ul << 20)
+
+/**
+ * Execution plan for a memory budget (--max-memory)
+ * @param stream Process the image in bands instead of one output buffer
+ * @param band_rows Source rows per band (streaming)
+ * @param threads Threads
+ * @param bytes Estimated peak memory of the plan
+ * @param full_bytes Estimated peak memory with one output buffer
+ */
+struct plan {
+    bool stream;
+    size_t band_rows;
+    size_t threads;
+    size_t bytes;
+    size_t full_bytes;
+};
+
+/**
+ * This function estimates the memory of streaming with bands of band_rows
+ * source rows: the source rows of a band, one band of output rows per
+ * factor and the buffers of the threads.
+ * @param width Width of the source image
+ * @param out_channels Samples per output pixel (1 or 3)
+ * @param sample_bytes Bytes per sample (1, or 2 for 16 bit images)
+ * @param factors Scaling factors
+ * @param nfactors Number of scaling factors
+ * @param band_rows Source rows per band
+ * @param threads Threads
+ * @return Estimated peak memory in bytes
+ */
+size_t plan_stream_bytes(size_t width, size_t out_channels, size_t sample_bytes, const size_t *factors,
+                         size_t nfactors, size_t band_rows, size_t threads);
+
+/**
+ * This function plans the execution of a job so that it stays below a
+ * memory budget. One output buffer is used if it fits, otherwise the image
+ * is streamed in bands: the band height is raised until every thread has
+ * about PLAN_BAND_BYTES of output rows or the budget is used up, and the
+ * number of threads is limited to the rows of a band. 16 bit images are
+ * streamed with bands of one row on one thread.
+ * @param budget Memory budget in bytes
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param channels Samples per input pixel (1 or 3)
+ * @param out_channels Samples per output pixel (1 or 3)
+ * @param sample_bytes Bytes per sample (1, or 2 for 16 bit images)
+ * @param factors Scaling factors
+ * @param nfactors Number of scaling factors
+ * @param rect Window of the output image (x, y, w, h), NULL for the whole image
+ * @param threads Requested threads
+ * @param can_stream The job can be streamed
+ * @param must_stream The job is streamed anyway (pipes, several factors, 16 bit)
+ * @param plan Plan
+ * @return 0 on success, -1 if no plan fits into the budget
+ */
+int plan_memory(size_t budget, size_t width, size_t height, size_t channels, size_t out_channels,
+                size_t sample_bytes, const size_t *factors, size_t nfactors, const size_t *rect, size_t threads,
+                bool can_stream, bool must_stream, struct plan *plan);
+
+/**
+ * This function returns the peak resident set size of the process.
+ * @return Peak RSS in bytes
+ */
+size_t plan_peak_rss(void);
@@ -0,0 +1,509 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <immintrin.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pnm.h"
+#include "hash.h"
+
+// Size of the read buffer for ASCII images
+#define ASCII_BUF (1 << 16)
+// Spaces behind the valid bytes of the read buffer, so 16 byte loads never see stale data
+#define ASCII_PAD 16
+// Values per line of an ASCII image (at most 4 characters each, lines stay below 70 characters)
+#define ASCII_LINE 17
+
+size_t create_metadata(char *metadata, bool ascii, size_t channels, size_t maxval, size_t new_width,
+                       size_t new_height) {
+    // Funny comment to add
+    const char *fun = "# Emir, Lukas and Benji are cool!\n";
+    char magic = (channels == 3) ? (ascii ? '3' : '6') : (ascii ? '2' : '5');
+    return (size_t)snprintf(metadata, METADATA_MAX, "P%c\n%s%lu %lu\n%lu\n", magic, fun, new_width, new_height,
+                            maxval);
+}
+
+int pnm_write_pixels(FILE *stream, const uint8_t *pixels, size_t width, size_t rows, bool ascii) {
+    if (!ascii) {
+        return (fwrite(pixels, sizeof(char), width * rows, stream) == width * rows) ? 0 : -1;
+    }
+
+    // Decimal representation of every value, followed by a space
+    static char digits[256][4];
+    static uint8_t lengths[256];
+    if (lengths[0] == 0) {
+        for (int v = 0; v < 256; v++) {
+            lengths[v] = (uint8_t)snprintf(digits[v], sizeof(digits[v]), "%d", v);
+        }
+    }
+
+    char buf[1 << 16];
+    size_t len = 0;
+    for (size_t r = 0; r < rows; r++) {
+        const uint8_t *row = pixels + r * width;
+        for (size_t x = 0; x < width; x++) {
+            if (len > sizeof(buf) - 8) {
+                if (fwrite(buf, sizeof(char), len, stream) != len) {
+                    return -1;
+                }
+                len = 0;
+            }
+            // Always copy 4 bytes, the length only advances by the digits
+            memcpy(buf + len, digits[row[x]], 4);
+            len += lengths[row[x]];
+            buf[len++] = (x + 1 == width || (x + 1) % ASCII_LINE == 0) ? '\n' : ' ';
+        }
+    }
+    return (fwrite(buf, sizeof(char), len, stream) == len) ? 0 : -1;
+}
+
+void pnm_cache_open(struct pnm_cache *cache, FILE *stream, bool input, bool drop) {
+    struct stat st;
+    cache->fd = fileno(stream);
+    cache->offset = ftello(stream);
+    if (cache->fd < 0 || cache->offset < 0 || fstat(cache->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        cache->fd = -1;
+        cache->offset = 0;
+    }
+    cache->ahead = cache->offset;
+    cache->flushed = cache->offset - cache->offset % PNM_CACHE_BLOCK;
+    cache->dropped = cache->flushed;
+    cache->drop = drop;
+    if (input && cache->fd >= 0) {
+        posix_fadvise(cache->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        pnm_cache_read(cache, cache->offset);
+    }
+}
+
+void pnm_cache_read(struct pnm_cache *cache, off_t offset) {
+    if (cache->fd < 0) {
+        return;
+    }
+    cache->offset = offset;
+    if (cache->ahead - offset < PNM_READAHEAD / 2) {
+        posix_fadvise(cache->fd, cache->ahead, offset + PNM_READAHEAD - cache->ahead, POSIX_FADV_WILLNEED);
+        cache->ahead = offset + PNM_READAHEAD;
+    }
+    off_t end = offset - offset % PNM_CACHE_BLOCK;
+    if (end > cache->dropped) {
+        posix_fadvise(cache->fd, cache->dropped, end - cache->dropped, POSIX_FADV_DONTNEED);
+        cache->dropped = end;
+    }
+}
+
+void pnm_cache_written(struct pnm_cache *cache, FILE *stream) {
+    if (cache->fd < 0) {
+        return;
+    }
+    off_t offset = ftello(stream);
+    off_t end = offset - offset % PNM_CACHE_BLOCK;
+    if (offset < 0 || end <= cache->flushed || fflush(stream) != 0) {
+        return;
+    }
+    // Dirty pages can't be dropped, the previous block has been written back while this one was computed
+    sync_file_range(cache->fd, cache->flushed, end - cache->flushed, SYNC_FILE_RANGE_WRITE);
+    if (cache->drop && cache->flushed > cache->dropped) {
+        sync_file_range(cache->fd, cache->dropped, cache->flushed - cache->dropped,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(cache->fd, cache->dropped, cache->flushed - cache->dropped, POSIX_FADV_DONTNEED);
+        cache->dropped = cache->flushed;
+    }
+    cache->flushed = end;
+}
+
+int pnm_write_cached(struct pnm_cache *cache, FILE *stream, const uint8_t *pixels, size_t width, size_t rows,
+                     bool ascii) {
+    size_t block = (width > 0 && width < PNM_CACHE_BLOCK) ? PNM_CACHE_BLOCK / width : 1;
+    for (size_t r = 0; r < rows; r += block) {
+        size_t n = (rows - r < block) ? rows - r : block;
+        if (pnm_write_pixels(stream, pixels + r * width, width, n, ascii) != 0) {
+            return -1;
+        }
+        pnm_cache_written(cache, stream);
+    }
+    return 0;
+}
+
+void pnm_prefetch(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, PNM_READAHEAD, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+/**
+ * This function swaps the bytes of count 16 bit samples while copying them,
+ * which converts between the big-endian samples of a PNM image and the host
+ * order. Eight samples are swapped at once with two shifts of an SSE2
+ * register. src and dst may be the same.
+ * @param src Samples
+ * @param dst Swapped samples
+ * @param count Number of samples
+ */
+static void swap16(const uint16_t *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+    for (; i < count; i++) {
+        dst[i] = (uint16_t)((src[i] << 8) | (src[i] >> 8));
+    }
+}
+
+int pnm_write_pixels16(FILE *stream, const uint16_t *pixels, size_t width, size_t rows, bool ascii) {
+    size_t count = width * rows;
+    if (!ascii) {
+        // Swapped in chunks, so the samples are converted on their way out
+        uint16_t buf[1 << 15];
+        for (size_t i = 0; i < count; i += sizeof(buf) / sizeof(buf[0])) {
+            size_t n = (count - i < sizeof(buf) / sizeof(buf[0])) ? count - i : sizeof(buf) / sizeof(buf[0]);
+            swap16(pixels + i, buf, n);
+            if (fwrite(buf, sizeof(uint16_t), n, stream) != n) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    char buf[1 << 16];
+    size_t len = 0;
+    for (size_t r = 0; r < rows; r++) {
+        const uint16_t *row = pixels + r * width;
+        for (size_t x = 0; x < width; x++) {
+            if (len > sizeof(buf) - 8) {
+                if (fwrite(buf, sizeof(char), len, stream) != len) {
+                    return -1;
+                }
+                len = 0;
+            }
+            // Digits from the back, at most 5 for a 16 bit value
+            char digits[5];
+            size_t n = 0;
+            unsigned v = row[x];
+            do {
+                digits[n++] = (char)('0' + v % 10);
+                v /= 10;
+            } while (v > 0);
+            while (n > 0) {
+                buf[len++] = digits[--n];
+            }
+            buf[len++] = (x + 1 == width || (x + 1) % ASCII_LINE == 0) ? '\n' : ' ';
+        }
+    }
+    return (fwrite(buf, sizeof(char), len, stream) == len) ? 0 : -1;
+}
+
+/**
+ * This function skips whitespace and comments of a PNM header.
+ * @param stream Input stream
+ * @return First character after the whitespace (or EOF)
+ */
+static int skip_space(FILE *stream) {
+    int ch;
+    while ((ch = getc(stream)) != EOF) {
+        if (ch == '#') {
+            // Comment until the end of the line
+            while ((ch = getc(stream)) != EOF && ch != '\n');
+        }
+        else if (!isspace(ch)) {
+            break;
+        }
+    }
+    return ch;
+}
+
+/**
+ * This function reads a decimal number of a PNM header.
+ * @param stream Input stream
+ * @param value Parsed value
+ * @param next Character that terminated the number
+ * @return 0 on success, -1 if there is no number or it is too large
+ */
+static int read_number(FILE *stream, size_t *value, int *next) {
+    int ch = skip_space(stream);
+    if (!isdigit(ch)) {
+        return -1;
+    }
+    size_t v = 0;
+    while (isdigit(ch)) {
+        if (v > (SIZE_MAX - 9) / 10) {
+            return -1;
+        }
+        v = v * 10 + (ch - '0');
+        ch = getc(stream);
+    }
+    *value = v;
+    *next = ch;
+    return 0;
+}
+
+int pnm_read_header(FILE *stream, struct pnm_header *header) {
+    int next;
+
+    // 1. Magic number
+    if (getc(stream) != 'P') {
+        return PNM_ERR_MAGIC;
+    }
+    header->magic = getc(stream);
+    if (header->magic != '2' && header->magic != '3' && header->magic != '5' && header->magic != '6') {
+        return PNM_ERR_MAGIC;
+    }
+
+    // 2. Width and height, the terminating character may start a comment
+    if (read_number(stream, &header->width, &next) != 0) {
+        return PNM_ERR_SIZE;
+    }
+    ungetc(next, stream);
+    if (read_number(stream, &header->height, &next) != 0) {
+        return PNM_ERR_SIZE;
+    }
+    ungetc(next, stream);
+
+    // 3. Maxval, followed by exactly one whitespace character
+    if (read_number(stream, &header->maxval, &next) != 0 || header->maxval == 0 || header->maxval > 65535) {
+        return PNM_ERR_MAXVAL;
+    }
+    if (next == EOF) {
+        return PNM_ERR_READ;
+    }
+    if (!isspace(next)) {
+        return PNM_ERR_SPACE;
+    }
+    return 0;
+}
+
+size_t pnm_channels(const struct pnm_header *header) {
+    return (header->magic == '3' || header->magic == '6') ? 3 : 1;
+}
+
+size_t pnm_sample_bytes(const struct pnm_header *header) {
+    return (header->maxval > 255) ? 2 : 1;
+}
+
+int pnm_skip(FILE *stream, size_t len) {
+    if (len == 0 || fseek(stream, len, SEEK_CUR) == 0) {
+        return 0;
+    }
+    // Not seekable, read the bytes instead
+    uint8_t buf[4096];
+    while (len > 0) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (fread(buf, sizeof(char), n, stream) != n) {
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+int pnm_reader_init(struct pnm_reader *reader, FILE *stream, const struct pnm_header *header) {
+    reader->stream = stream;
+    reader->header = *header;
+    reader->buf = NULL;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->eof = false;
+    reader->hashing = false;
+    reader->hash = 0;
+    pnm_cache_open(&reader->cache, stream, true, true);
+    if (header->magic == '2' || header->magic == '3') {
+        reader->buf = malloc(ASCII_BUF + ASCII_PAD);
+        if (reader->buf == NULL) {
+            return PNM_ERR_MEMORY;
+        }
+        memset(reader->buf, ' ', ASCII_PAD);
+    }
+    return 0;
+}
+
+/**
+ * This function moves the unparsed bytes of an ASCII reader to the front of
+ * the buffer and fills the rest from the input.
+ * @param reader Reader
+ * @return 0 on success, PNM_ERR_READ if the input could not be read
+ */
+static int ascii_refill(struct pnm_reader *reader) {
+    size_t rest = reader->len - reader->pos;
+    memmove(reader->buf, reader->buf + reader->pos, rest);
+    reader->pos = 0;
+    reader->len = rest;
+
+    size_t n = fread(reader->buf + rest, sizeof(char), ASCII_BUF - rest, reader->stream);
+    pnm_cache_read(&reader->cache, reader->cache.offset + n);
+    if (n < ASCII_BUF - rest) {
+        if (ferror(reader->stream)) {
+            return PNM_ERR_READ;
+        }
+        reader->eof = true;
+    }
+    reader->len += n;
+    memset(reader->buf + reader->len, ' ', ASCII_PAD);
+    return 0;
+}
+
+/**
+ * This function parses decimal samples of an ASCII image. Every step loads 16
+ * bytes and classifies them with SSE2 compares into digits and whitespace;
+ * the separator in front of the next number and the number itself are then
+ * found with a count of trailing zeros of the masks instead of one check per
+ * character.
+ * @param reader Reader
+ * @param out Parsed samples of an 8 bit image (or NULL)
+ * @param out16 Parsed samples of a 16 bit image (or NULL)
+ * @param count Number of samples
+ * @return 0 on success, one of the PNM_ERR_* values otherwise
+ */
+static int ascii_read(struct pnm_reader *reader, uint8_t *out, uint16_t *out16, size_t count) {
+    const __m128i below_zero = _mm_set1_epi8('0' - 1);
+    const __m128i above_nine = _mm_set1_epi8('9' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i below_tab = _mm_set1_epi8('\t' - 1);
+    const __m128i above_cr = _mm_set1_epi8('\r' + 1);
+
+    size_t n = 0;
+    while (n < count) {
+        // A number and its separators always fit into the remaining bytes after a refill
+        if (reader->len - reader->pos < 32 && !reader->eof && ascii_refill(reader) != 0) {
+            return PNM_ERR_READ;
+        }
+        if (reader->pos >= reader->len) {
+            return PNM_ERR_READ;
+        }
+
+        __m128i v = _mm_loadu_si128((const __m128i *)(reader->buf + reader->pos));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, below_zero), _mm_cmplt_epi8(v, above_nine));
+        __m128i white = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                     _mm_and_si128(_mm_cmpgt_epi8(v, below_tab), _mm_cmplt_epi8(v, above_cr)));
+        unsigned dmask = (unsigned)_mm_movemask_epi8(digit);
+        unsigned wmask = (unsigned)_mm_movemask_epi8(white);
+
+        // Separator in front of the next number
+        unsigned lead = dmask ? (unsigned)__builtin_ctz(dmask) : 16;
+        unsigned lead_mask = (1u << lead) - 1;
+        if ((wmask & lead_mask) != lead_mask) {
+            return PNM_ERR_DATA;
+        }
+        // Digits of the number, it has to be followed by whitespace within the 16 bytes
+        unsigned len = (unsigned)__builtin_ctz(~(dmask >> lead));
+        if (lead + len >= 16) {
+            if (lead == 0) {
+                return PNM_ERR_DATA;
+            }
+            reader->pos += lead;
+            if (reader->pos > reader->len) {
+                reader->pos = reader->len;
+            }
+            continue;
+        }
+        if (!((wmask >> (lead + len)) & 1) || len > 5) {
+            return PNM_ERR_DATA;
+        }
+
+        const uint8_t *p = reader->buf + reader->pos + lead;
+        size_t value = 0;
+        for (unsigned i = 0; i < len; i++) {
+            value = value * 10 + (p[i] - '0');
+        }
+        if (value > reader->header.maxval) {
+            return PNM_ERR_DATA;
+        }
+        if (out16 != NULL) {
+            out16[n++] = (uint16_t)value;
+        }
+        else {
+            out[n++] = (uint8_t)value;
+        }
+        reader->pos += lead + len;
+    }
+    return 0;
+}
+
+/**
+ * This function reads the bytes of a binary image and moves the read position
+ * of the page cache hints.
+ * @param reader Reader
+ * @param out Bytes
+ * @param len Number of bytes
+ * @return 0 on success, PNM_ERR_READ otherwise
+ */
+static int read_binary(struct pnm_reader *reader, void *out, size_t len) {
+    size_t n = fread(out, sizeof(char), len, reader->stream);
+    pnm_cache_read(&reader->cache, reader->cache.offset + n);
+    return (n == len) ? 0 : PNM_ERR_READ;
+}
+
+void pnm_reader_hash(struct pnm_reader *reader, uint64_t seed) {
+    reader->hashing = true;
+    reader->hash = seed;
+}
+
+int pnm_read_rows(struct pnm_reader *reader, size_t rows, uint8_t *out) {
+    size_t count = rows * reader->header.width * pnm_channels(&reader->header);
+    if (reader->hashing) {
+        // Block by block, every block is hashed right after it was read
+        for (size_t off = 0; off < count; off += PNM_HASH_BLOCK) {
+            size_t n = (count - off < PNM_HASH_BLOCK) ? count - off : PNM_HASH_BLOCK;
+            int err = (reader->buf != NULL) ? ascii_read(reader, out + off, NULL, n) : read_binary(reader, out + off, n);
+            if (err != 0) {
+                return err;
+            }
+            reader->hash = hash_block(reader->hash, out + off, n);
+        }
+        return 0;
+    }
+    if (reader->buf != NULL) {
+        return ascii_read(reader, out, NULL, count);
+    }
+    return read_binary(reader, out, count);
+}
+
+int pnm_read_rows16(struct pnm_reader *reader, size_t rows, uint16_t *out) {
+    size_t count = rows * reader->header.width * pnm_channels(&reader->header);
+    if (reader->buf != NULL) {
+        return ascii_read(reader, NULL, out, count);
+    }
+    if (read_binary(reader, out, count * sizeof(uint16_t)) != 0) {
+        return PNM_ERR_READ;
+    }
+    // The rows are still in the cache, the samples are swapped in place
+    swap16(out, out, count);
+    return 0;
+}
+
+int pnm_skip_rows(struct pnm_reader *reader, size_t rows) {
+    size_t rowlen = reader->header.width * pnm_channels(&reader->header);
+    if (reader->buf == NULL) {
+        size_t len = rows * rowlen * pnm_sample_bytes(&reader->header);
+        if (pnm_skip(reader->stream, len) != 0) {
+            return PNM_ERR_READ;
+        }
+        pnm_cache_read(&reader->cache, reader->cache.offset + len);
+        return 0;
+    }
+
+    // ASCII rows have no fixed length, they are parsed and dropped
+    uint16_t *row = malloc(rowlen * sizeof(uint16_t));
+    if (row == NULL) {
+        return PNM_ERR_MEMORY;
+    }
+    int ret = 0;
+    for (size_t r = 0; r < rows && ret == 0; r++) {
+        ret = ascii_read(reader, NULL, row, rowlen);
+    }
+    free(row);
+    return ret;
+}
+
+void pnm_reader_free(struct pnm_reader *reader) {
+    free(reader->buf);
+    reader->buf = NULL;
+}
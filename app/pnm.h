@@ -0,0 +1,270 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Upper bound for the length of the header written by create_metadata
+#define METADATA_MAX 128
+
+/**
+ * This function writes the header of an output image (magic number, comment,
+ * dimensions and maxval) into metadata.
+ * @param metadata Buffer of at least METADATA_MAX bytes
+ * @param ascii Write the header of an ASCII image (P2, P3) instead of P5, P6
+ * @param channels Samples per pixel, 1 for grayscale (P5, P2) and 3 for color images (P6, P3)
+ * @param maxval Maximum sample value (255, or up to 65535 for 16 bit images)
+ * @param new_width Width of the output image
+ * @param new_height Height of the output image
+ * @return Length of the header in bytes (without terminating null byte)
+ */
+size_t create_metadata(char *metadata, bool ascii, size_t channels, size_t maxval, size_t new_width,
+                       size_t new_height);
+
+/**
+ * This function writes rows of samples to an output image, either binary
+ * (P5, P6) or as decimal numbers (P2, P3). The decimal strings are taken from
+ * a lookup table and copied into a large buffer, so there is no stdio call
+ * per pixel.
+ * @param stream Output stream
+ * @param pixels Samples (width * rows, row-major)
+ * @param width Samples per row (3 per pixel for color images)
+ * @param rows Number of rows
+ * @param ascii Write decimal numbers (P2, P3)
+ * @return 0 on success, -1 otherwise
+ */
+int pnm_write_pixels(FILE *stream, const uint8_t *pixels, size_t width, size_t rows, bool ascii);
+
+/**
+ * This function is pnm_write_pixels for 16 bit samples. Binary images store
+ * them big-endian, the samples are byte-swapped with SSE2 while they are
+ * copied into the write buffer.
+ * @param stream Output stream
+ * @param pixels Samples in host byte order (width * rows, row-major)
+ * @param width Samples per row
+ * @param rows Number of rows
+ * @param ascii Write decimal numbers (P2, P3)
+ * @return 0 on success, -1 otherwise
+ */
+int pnm_write_pixels16(FILE *stream, const uint16_t *pixels, size_t width, size_t rows, bool ascii);
+
+// Consumed input and written output leave the page cache in blocks of this size
+#define PNM_CACHE_BLOCK (8l << 20)
+// Read-ahead window in front of the read position of an input
+#define PNM_READAHEAD (32l << 20)
+
+/**
+ * Page cache hints for a file that is read or written sequentially. Inputs
+ * get read-ahead in front of the read position and drop the pages behind it,
+ * outputs start the writeback of every written block and, if requested, drop
+ * it once it is on disk, so large jobs don't fill the page cache with data
+ * nobody reads again.
+ * @param fd Descriptor of the file, -1 if it is no regular file (pipe, terminal)
+ * @param offset Offset up to which the file was consumed (input)
+ * @param ahead Offset up to which read-ahead was requested (input)
+ * @param flushed Offset up to which the writeback was started (output)
+ * @param dropped Offset up to which the pages were dropped
+ * @param drop Drop the written pages (output)
+ */
+struct pnm_cache {
+    int fd;
+    off_t offset;
+    off_t ahead;
+    off_t flushed;
+    off_t dropped;
+    bool drop;
+};
+
+/**
+ * This function prepares the page cache hints for a stream. An input is
+ * marked as read sequentially and the first PNM_READAHEAD bytes behind the
+ * current position are requested. Dropping the pages of an output is opt-in:
+ * an output that is read again right away (e.g. by --cache) keeps them.
+ * @param cache Hints to be initialized
+ * @param stream Input or output stream
+ * @param input The stream is read
+ * @param drop Drop the pages of an output once they are on disk
+ */
+void pnm_cache_open(struct pnm_cache *cache, FILE *stream, bool input, bool drop);
+
+/**
+ * This function moves the read position of an input: the read-ahead window
+ * is extended once half of it has been consumed, and every complete block
+ * of PNM_CACHE_BLOCK bytes behind the position is dropped.
+ * @param cache Hints of the input
+ * @param offset Offset up to which the input has been consumed
+ */
+void pnm_cache_read(struct pnm_cache *cache, off_t offset);
+
+/**
+ * This function is called after writing to an output. Once a block of
+ * PNM_CACHE_BLOCK bytes is complete, the stream is flushed and the writeback
+ * of the block is started. With drop, the block before it is waited for and
+ * dropped, so the writeback of one block overlaps with the computation of
+ * the next.
+ * @param cache Hints of the output
+ * @param stream Output stream
+ */
+void pnm_cache_written(struct pnm_cache *cache, FILE *stream);
+
+/**
+ * This function is pnm_write_pixels for an output with page cache hints: the
+ * rows are written in blocks of about PNM_CACHE_BLOCK bytes with
+ * pnm_cache_written after every block.
+ * @param cache Hints of the output
+ * @param stream Output stream
+ * @param pixels Samples (width * rows, row-major)
+ * @param width Samples per row (3 per pixel for color images)
+ * @param rows Number of rows
+ * @param ascii Write decimal numbers (P2, P3)
+ * @return 0 on success, -1 otherwise
+ */
+int pnm_write_cached(struct pnm_cache *cache, FILE *stream, const uint8_t *pixels, size_t width, size_t rows,
+                     bool ascii);
+
+/**
+ * This function requests the first PNM_READAHEAD bytes of a file that will be
+ * read soon (e.g. the input of a queued job), the read continues in the
+ * background.
+ * @param path Path of the file
+ */
+void pnm_prefetch(const char *path);
+
+// Errors of pnm_read_header and the pnm_reader functions
+#define PNM_ERR_READ -1     // Input ended or could not be read
+#define PNM_ERR_MAGIC -2    // Unsupported magic number
+#define PNM_ERR_SIZE -3     // Width or height missing or too large
+#define PNM_ERR_MAXVAL -4   // Maxval missing, zero or above 65535
+#define PNM_ERR_SPACE -5    // No whitespace after maxval
+#define PNM_ERR_DATA -6     // Sample of an ASCII image is no number or above maxval
+#define PNM_ERR_MEMORY -7   // Buffer could not be allocated
+
+// Block size in which pnm_read_rows hashes the samples
+#define PNM_HASH_BLOCK 65536
+
+/**
+ * Header of a PNM image
+ * @param magic Digit of the magic number ('2', '3', '5' or '6')
+ * @param width Width
+ * @param height Height
+ * @param maxval Maximum sample value
+ */
+struct pnm_header {
+    char magic;
+    size_t width;
+    size_t height;
+    size_t maxval;
+};
+
+/**
+ * This function parses the header of a PPM (P3, P6) or PGM (P2, P5) image
+ * with 8 or 16 bit samples (maxval up to 65535).
+ * The stream is only read forward (no fseek), so the input may also be a
+ * pipe. Comments are skipped, and after a successful call the stream is
+ * positioned at the first byte of the image data.
+ * @param stream Input stream
+ * @param header Parsed header
+ * @return 0 on success, one of the PNM_ERR_* values otherwise
+ */
+int pnm_read_header(FILE *stream, struct pnm_header *header);
+
+/**
+ * This function returns the number of samples per pixel of an image: 3 for
+ * color images (P3, P6), 1 for grayscale images (P2, P5).
+ * @param header Header of the image
+ */
+size_t pnm_channels(const struct pnm_header *header);
+
+/**
+ * This function returns the size of a sample of a binary image: 1 byte up to
+ * maxval 255, 2 bytes (big-endian) above.
+ * @param header Header of the image
+ */
+size_t pnm_sample_bytes(const struct pnm_header *header);
+
+/**
+ * This function skips len bytes of the input. Seekable files are positioned
+ * with fseek, other inputs (pipes) are read and discarded.
+ * @param stream Input stream
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the input ended before
+ */
+int pnm_skip(FILE *stream, size_t len);
+
+/**
+ * Reader for the image data of a PNM image
+ * @param stream Input stream, positioned after the header
+ * @param header Header of the image
+ * @param buf Read buffer for ASCII images (NULL for binary images)
+ * @param pos Position of the next unparsed byte in buf
+ * @param len Number of valid bytes in buf
+ * @param eof The input has ended
+ * @param hashing pnm_read_rows hashes the samples it returns
+ * @param hash Hash of the samples returned so far (hash_block)
+ * @param cache Page cache hints of the input
+ */
+struct pnm_reader {
+    FILE *stream;
+    struct pnm_header header;
+    uint8_t *buf;
+    size_t pos;
+    size_t len;
+    bool eof;
+    bool hashing;
+    uint64_t hash;
+    struct pnm_cache cache;
+};
+
+/**
+ * This function prepares a reader for the image data that follows the header.
+ * @param reader Reader to be initialized
+ * @param stream Input stream, positioned after the header
+ * @param header Header of the image
+ * @return 0 on success, PNM_ERR_MEMORY otherwise
+ */
+int pnm_reader_init(struct pnm_reader *reader, FILE *stream, const struct pnm_header *header);
+
+/**
+ * This function lets pnm_read_rows hash the samples of the rows it returns.
+ * The rows are read and hashed in blocks of PNM_HASH_BLOCK bytes, so every
+ * block is hashed while it is still in the cache.
+ * @param reader Reader
+ * @param seed Start value of the hash
+ */
+void pnm_reader_hash(struct pnm_reader *reader, uint64_t seed);
+
+/**
+ * This function reads the next rows of an 8 bit image. Every row consists of
+ * width * pnm_channels() samples, ASCII images are converted to the same
+ * layout as the binary ones.
+ * @param reader Reader
+ * @param rows Number of rows
+ * @param out Samples of the rows
+ * @return 0 on success, one of the PNM_ERR_* values otherwise
+ */
+int pnm_read_rows(struct pnm_reader *reader, size_t rows, uint8_t *out);
+
+/**
+ * This function reads the next rows of a 16 bit image (maxval above 255).
+ * The big-endian samples are swapped to host order right after the read,
+ * while the rows are still in the cache.
+ * @param reader Reader
+ * @param rows Number of rows
+ * @param out Samples of the rows
+ * @return 0 on success, one of the PNM_ERR_* values otherwise
+ */
+int pnm_read_rows16(struct pnm_reader *reader, size_t rows, uint16_t *out);
+
+/**
+ * This function skips the next rows of the image.
+ * @param reader Reader
+ * @param rows Number of rows
+ * @return 0 on success, one of the PNM_ERR_* values otherwise
+ */
+int pnm_skip_rows(struct pnm_reader *reader, size_t rows);
+
+/**
+ * This function frees the buffers of a reader.
+ * @param reader Reader
+ */
+void pnm_reader_free(struct pnm_reader *reader);
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "pool.h"
+
+/**
+ * Argument of a worker thread
+ * @param pool Pool
+ * @param worker Index of the worker
+ */
+struct worker_arg {
+    struct pool *pool;
+    size_t worker;
+};
+
+/**
+ * This function takes the next task from the front of the worker's own deque.
+ * @param deque Deque of the worker
+ * @param task Task
+ * @return true if there was a task
+ */
+static bool take(struct pool_deque *deque, size_t *task) {
+    bool found = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->next < deque->end) {
+        *task = deque->next++;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * This function moves the back half of the tasks of another worker into the
+ * (empty) deque of worker. The victims are tried in a round robin, starting
+ * after the worker itself.
+ * @param pool Pool
+ * @param worker Index of the thief
+ * @return true if tasks were stolen
+ */
+static bool steal(struct pool *pool, size_t worker) {
+    for (size_t k = 1; k < pool->nworkers; k++) {
+        struct pool_deque *victim = &pool->deques[(worker + k) % pool->nworkers];
+        size_t first = 0, end = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            // The victim keeps the front half (at least the task it would take next)
+            size_t count = (victim->end - victim->next) / 2;
+            if (count == 0) {
+                count = 1;
+            }
+            end = victim->end;
+            first = end - count;
+            victim->end = first;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (first < end) {
+            struct pool_deque *own = &pool->deques[worker];
+            pthread_mutex_lock(&own->lock);
+            own->next = first;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * This function runs the tasks of one worker until no deque has tasks left.
+ * @param pool Pool
+ * @param worker Index of the worker
+ */
+static void work(struct pool *pool, size_t worker) {
+    size_t task;
+    do {
+        while (take(&pool->deques[worker], &task)) {
+            pool->fn(pool->ctx, task, worker);
+        }
+    } while (pool->stealing && steal(pool, worker));
+}
+
+/**
+ * This function is the main loop of the threads 1 .. nworkers - 1.
+ * @param arg Argument of the worker (struct worker_arg)
+ */
+static void *worker_main(void *arg) {
+    struct worker_arg *wa = arg;
+    struct pool *pool = wa->pool;
+    size_t worker = wa->worker;
+    free(wa);
+    size_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int pool_create(struct pool *pool, size_t nworkers) {
+    pool->nworkers = nworkers;
+    pool->generation = 0;
+    pool->running = 0;
+    pool->stop = false;
+    pool->stealing = true;
+    pool->steals = 0;
+    pool->threads = malloc(nworkers * sizeof(pthread_t));
+    pool->deques = malloc(nworkers * sizeof(struct pool_deque));
+    if (pool->threads == NULL || pool->deques == NULL) {
+        free(pool->threads);
+        free(pool->deques);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (size_t w = 0; w < nworkers; w++) {
+        pthread_mutex_init(&pool->deques[w].lock, NULL);
+        pool->deques[w].next = 0;
+        pool->deques[w].end = 0;
+    }
+
+    for (size_t w = 1; w < nworkers; w++) {
+        struct worker_arg *wa = malloc(sizeof(struct worker_arg));
+        if (wa == NULL) {
+            pool->nworkers = w;
+            pool_destroy(pool);
+            return -1;
+        }
+        wa->pool = pool;
+        wa->worker = w;
+        if (pthread_create(&pool->threads[w], NULL, worker_main, wa) != 0) {
+            free(wa);
+            pool->nworkers = w;
+            pool_destroy(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void pool_block(const struct pool *pool, size_t ntasks, size_t worker, size_t *first, size_t *end) {
+    // Contiguous blocks, the first ntasks % nworkers workers get one task more
+    size_t n = pool->nworkers;
+    size_t extra = ntasks % n;
+    *first = worker * (ntasks / n) + (worker < extra ? worker : extra);
+    *end = *first + ntasks / n + (worker < extra ? 1 : 0);
+}
+
+/**
+ * This function runs the tasks that are in the deques on all workers and
+ * returns when all of them are done.
+ * @param pool Pool
+ * @param fn Task function
+ * @param ctx Context for fn
+ * @param stealing Idle workers steal from the other deques
+ */
+static void run(struct pool *pool, pool_fn fn, void *ctx, bool stealing) {
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->stealing = stealing;
+    pool->running = pool->nworkers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_run(struct pool *pool, size_t ntasks, pool_fn fn, void *ctx) {
+    for (size_t w = 0; w < pool->nworkers; w++) {
+        pthread_mutex_lock(&pool->deques[w].lock);
+        pool_block(pool, ntasks, w, &pool->deques[w].next, &pool->deques[w].end);
+        pthread_mutex_unlock(&pool->deques[w].lock);
+    }
+    run(pool, fn, ctx, true);
+}
+
+void pool_each(struct pool *pool, pool_fn fn, void *ctx) {
+    for (size_t w = 0; w < pool->nworkers; w++) {
+        pthread_mutex_lock(&pool->deques[w].lock);
+        pool->deques[w].next = w;
+        pool->deques[w].end = w + 1;
+        pthread_mutex_unlock(&pool->deques[w].lock);
+    }
+    run(pool, fn, ctx, false);
+}
+
+void pool_destroy(struct pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t w = 1; w < pool->nworkers; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    for (size_t w = 0; w < pool->nworkers; w++) {
+        pthread_mutex_destroy(&pool->deques[w].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->deques);
+}
@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Upper bound for the number of workers of a pool
+#define POOL_MAX_WORKERS 256
+
+/**
+ * Task function of a pool
+ * @param ctx Context passed to pool_run
+ * @param task Index of the task (0 .. ntasks - 1)
+ * @param worker Index of the worker that runs the task (0 .. nworkers - 1)
+ */
+typedef void (*pool_fn)(void *ctx, size_t task, size_t worker);
+
+/**
+ * Deque of a worker: the range next .. end - 1 of task indices. The owner
+ * takes tasks from the front, thieves take the back half.
+ * @param lock Protects next and end
+ * @param next Next task of the owner
+ * @param end End of the range
+ */
+struct pool_deque {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+};
+
+/**
+ * Thread pool with one deque per worker. Worker 0 is the thread that calls
+ * pool_run, the others wait for the next run.
+ * @param nworkers Number of workers
+ * @param threads Threads of the workers 1 .. nworkers - 1
+ * @param deques One deque per worker
+ * @param lock Protects generation, running and stop
+ * @param start Signals a new run (or stop) to the workers
+ * @param done Signals the end of the last worker to pool_run
+ * @param generation Number of the current run
+ * @param running Number of workers that have not finished the current run
+ * @param stop The workers exit
+ * @param stealing Idle workers steal from the other deques in the current run
+ * @param fn Task function of the current run
+ * @param ctx Context of the current run
+ * @param steals Number of successful steals of all runs
+ */
+struct pool {
+    size_t nworkers;
+    pthread_t *threads;
+    struct pool_deque *deques;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    size_t generation;
+    size_t running;
+    bool stop;
+    bool stealing;
+    pool_fn fn;
+    void *ctx;
+    size_t steals;
+};
+
+/**
+ * This function starts nworkers - 1 threads, the calling thread is the
+ * first worker.
+ * @param pool Pool to be initialized
+ * @param nworkers Number of workers (1 .. POOL_MAX_WORKERS)
+ * @return 0 on success, -1 if the threads could not be started
+ */
+int pool_create(struct pool *pool, size_t nworkers);
+
+/**
+ * This function runs the tasks 0 .. ntasks - 1 on all workers and returns
+ * when all of them are done. Every worker starts with a contiguous block of
+ * tasks (neighbouring tiles share their source rows), a worker whose deque
+ * is empty steals half of the remaining tasks of another worker.
+ * @param pool Pool
+ * @param ntasks Number of tasks
+ * @param fn Task function
+ * @param ctx Context for fn
+ */
+void pool_run(struct pool *pool, size_t ntasks, pool_fn fn, void *ctx);
+
+/**
+ * This function runs fn once on every worker (task = worker index) without
+ * stealing, e.g. to pin the threads or to first-touch the memory a worker
+ * will write.
+ * @param pool Pool
+ * @param fn Task function
+ * @param ctx Context for fn
+ */
+void pool_each(struct pool *pool, pool_fn fn, void *ctx);
+
+/**
+ * This function returns the block of tasks pool_run initially puts into the
+ * deque of a worker.
+ * @param pool Pool
+ * @param ntasks Number of tasks
+ * @param worker Index of the worker
+ * @param first First task of the block
+ * @param end End of the block
+ */
+void pool_block(const struct pool *pool, size_t ntasks, size_t worker, size_t *first, size_t *end);
+
+/**
+ * This function stops the threads and frees the pool.
+ * @param pool Pool
+ */
+void pool_destroy(struct pool *pool);
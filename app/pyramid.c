@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "interpolate.h"
+#include "pnm.h"
+#include "hash.h"
+#include "pyramid.h"
+#include "trace.h"
+
+/**
+ * This function creates a directory, an existing directory is no error.
+ * @param path Path of the directory
+ * @return 0 on success, -1 otherwise
+ */
+static int make_dir(const char *path) {
+    if (mkdir(path, S_IRWXU) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * This function writes a tile as PGM file. The tile is written to a temporary
+ * file first and renamed afterwards, so a cancelled run never leaves a
+ * truncated tile behind that would be taken from the cache later.
+ * @param path Path of the tile
+ * @param tile Pixels of the tile
+ * @param w Width of the tile
+ * @param h Height of the tile
+ * @return 0 on success, -1 otherwise
+ */
+static int write_tile(const char *path, const uint8_t *tile, size_t w, size_t h) {
+    char tmppath[PATH_MAX];
+    if (snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= (int)sizeof(tmppath)) {
+        return -1;
+    }
+    FILE *outstream = fopen(tmppath, "wb");
+    if (outstream == NULL) {
+        return -1;
+    }
+
+    char metadata[METADATA_MAX];
+    size_t metalen = create_metadata(metadata, false, 1, 255, w, h);
+    if (fwrite(metadata, sizeof(char), metalen, outstream) != metalen ||
+        fwrite(tile, sizeof(char), w * h, outstream) != w * h) {
+        fclose(outstream);
+        unlink(tmppath);
+        return -1;
+    }
+    if (fclose(outstream) != 0 || rename(tmppath, path) != 0) {
+        unlink(tmppath);
+        return -1;
+    }
+    return 0;
+}
+
+int pyramid(const uint8_t *gray, size_t width, size_t height, const size_t *factors, size_t nfactors, size_t tile,
+            const char *dir, struct pyramid_stats *stats) {
+    // The tile directory is addressed by the content of the grayscale image
+    uint64_t dims[2] = { width, height };
+    stats->key = hash_bytes(HASH_INIT, (const uint8_t *)dims, sizeof(dims));
+    stats->key = hash_bytes(stats->key, gray, width * height);
+    stats->written = 0;
+    stats->skipped = 0;
+
+    uint8_t *buf = malloc(tile * tile);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    int ret = 0;
+    snprintf(path, sizeof(path), "%s/%016lx", dir, stats->key);
+    if (make_dir(dir) != 0 || make_dir(path) != 0) {
+        ret = -1;
+    }
+    snprintf(path, sizeof(path), "%s/%016lx/%lu", dir, stats->key, tile);
+    if (ret == 0 && make_dir(path) != 0) {
+        ret = -1;
+    }
+
+    for (size_t k = 0; k < nfactors && ret == 0; k++) {
+        size_t s = factors[k];
+        size_t new_width = width * s;
+        size_t new_height = height * s;
+
+        snprintf(path, sizeof(path), "%s/%016lx/%lu/%lu", dir, stats->key, tile, s);
+        if (make_dir(path) != 0) {
+            ret = -1;
+            break;
+        }
+
+        for (size_t y = 0; y < new_height && ret == 0; y += tile) {
+            for (size_t x = 0; x < new_width; x += tile) {
+                if (snprintf(path, sizeof(path), "%s/%016lx/%lu/%lu/%lu_%lu.pgm", dir, stats->key, tile, s,
+                             y / tile, x / tile) >= (int)sizeof(path)) {
+                    ret = -1;
+                    break;
+                }
+                // Tile is already in the cache
+                if (access(path, F_OK) == 0) {
+                    stats->skipped++;
+                    continue;
+                }
+
+                // Tiles at the right and bottom edge are cut off
+                size_t w = (new_width - x < tile) ? new_width - x : tile;
+                size_t h = (new_height - y < tile) ? new_height - y : tile;
+                uint64_t t = trace_begin();
+                interpolate_region(gray, 0, width, height, s, x, y, w, h, buf);
+                if (write_tile(path, buf, w, h) != 0) {
+                    ret = -1;
+                    break;
+                }
+                trace_end("Kachel", (long)(y / tile * ((new_width + tile - 1) / tile) + x / tile), t);
+                stats->written++;
+            }
+        }
+    }
+
+    free(buf);
+    return ret;
+}
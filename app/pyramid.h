@@ -0,0 +1,34 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Counters of a pyramid run
+ * @param key Content address of the grayscale image (name of its tile directory)
+ * @param written Number of tiles that were computed and written
+ * @param skipped Number of tiles that were already present in the cache
+ */
+struct pyramid_stats {
+    uint64_t key;
+    size_t written;
+    size_t skipped;
+};
+
+/**
+ * This function generates the tiles of a zoom pyramid from one grayscale
+ * image. For every scaling factor the output image is cut into tile x tile
+ * tiles (smaller at the right and bottom edge), which are computed with
+ * interpolate_region and written as PGM files to
+ * <dir>/<key>/<tile>/<factor>/<row>_<col>.pgm. The key is a hash of the
+ * grayscale image, so tiles that already exist are up to date and skipped.
+ * @param gray Grayscale image
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param factors Scaling factors of the zoom levels
+ * @param nfactors Number of zoom levels
+ * @param tile Edge length of the tiles
+ * @param dir Root of the tile cache
+ * @param stats Counters of the run
+ * @return 0 on success, -1 if a directory or tile could not be written
+ */
+int pyramid(const uint8_t *gray, size_t width, size_t height, const size_t *factors, size_t nfactors, size_t tile,
+            const char *dir, struct pyramid_stats *stats);
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "interpolate.h"
+#include "grayscale.h"
+#include "kernel.h"
+#include "pnm.h"
+#include "serve.h"
+
+/**
+ * Buffers of a worker, they only grow and are reused by all of its jobs
+ * @param img Source image
+ * @param img_cap Capacity of img
+ * @param tmp Grayscale image
+ * @param tmp_cap Capacity of tmp
+ * @param result Output image
+ * @param result_cap Capacity of result
+ */
+struct serve_buffers {
+    uint8_t *img;
+    size_t img_cap;
+    uint8_t *tmp;
+    size_t tmp_cap;
+    uint8_t *result;
+    size_t result_cap;
+};
+
+/**
+ * Job descriptor
+ * @param in Path of the input image
+ * @param in_fd Input file descriptor (in=fd), -1 for a path
+ * @param out Path of the output image
+ * @param factor Scaling factor
+ * @param coeffs Coefficients for the grayscale conversion
+ * @param impl Version of the kernel (-V)
+ * @param ascii Write the output as ASCII image (P2)
+ */
+struct serve_job {
+    char in[PATH_MAX];
+    int in_fd;
+    char out[PATH_MAX];
+    size_t factor;
+    float coeffs[3];
+    size_t impl;
+    bool ascii;
+};
+
+/**
+ * This function returns the monotonic time in seconds.
+ */
+static double now(void) {
+    struct timespec t;
+    clock_gettime(1, &t); // 1 expands to CLOCK_MONOTONIC
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * This function grows a buffer of a worker to at least len bytes.
+ * @param buf Buffer
+ * @param cap Capacity of the buffer
+ * @param len Needed length
+ * @return 0 on success, -1 otherwise
+ */
+static int reserve(uint8_t **buf, size_t *cap, size_t len) {
+    if (len <= *cap) {
+        return 0;
+    }
+    uint8_t *grown = realloc(*buf, len);
+    if (grown == NULL) {
+        return -1;
+    }
+    *buf = grown;
+    *cap = len;
+    return 0;
+}
+
+/**
+ * This function parses a job descriptor.
+ * @param line Descriptor (key=value pairs separated by spaces), is modified
+ * @param job Job
+ * @param fd File descriptor that was passed with the line, -1 if none
+ * @return NULL on success, an error message otherwise
+ */
+static const char *parse_job(char *line, struct serve_job *job, int fd) {
+    memset(job, 0, sizeof(*job));
+    job->in_fd = -1;
+    char *save;
+    for (char *tok = strtok_r(line, " \t", &save); tok != NULL; tok = strtok_r(NULL, " \t", &save)) {
+        char *value = strchr(tok, '=');
+        if (value == NULL) {
+            return "Das Argument ist kein key=value Paar.";
+        }
+        *value++ = '\0';
+        char *end;
+        if (strcmp(tok, "in") == 0) {
+            if (strcmp(value, "fd") == 0) {
+                if (fd < 0) {
+                    return "Mit in=fd wurde kein Dateideskriptor übergeben.";
+                }
+                job->in_fd = fd;
+            }
+            else if (snprintf(job->in, sizeof(job->in), "%s", value) >= (int)sizeof(job->in)) {
+                return "Der Pfad der Eingabedatei ist zu lang.";
+            }
+        }
+        else if (strcmp(tok, "out") == 0) {
+            if (snprintf(job->out, sizeof(job->out), "%s", value) >= (int)sizeof(job->out)) {
+                return "Der Pfad der Ausgabedatei ist zu lang.";
+            }
+        }
+        else if (strcmp(tok, "f") == 0) {
+            job->factor = strtoul(value, &end, 10);
+            if (*end != '\0' || job->factor == 0) {
+                return "Der Skalierungsfaktor muss eine Zahl größer 0 sein.";
+            }
+        }
+        else if (strcmp(tok, "coeffs") == 0) {
+            for (int i = 0; i < 3; i++) {
+                job->coeffs[i] = strtof(value, &end);
+                if (end == value || *end != (i < 2 ? ',' : '\0')) {
+                    return "Die Koeffizienten müssen als a,b,c angegeben werden.";
+                }
+                value = end + 1;
+            }
+        }
+        else if (strcmp(tok, "V") == 0) {
+            int version = kernel_find(value);
+            if (version < 0) {
+                return "Das Argument 'V' muss eine Implementierung aus --list-kernels sein.";
+            }
+            job->impl = (size_t)version;
+        }
+        else if (strcmp(tok, "ascii") == 0) {
+            job->ascii = strcmp(value, "1") == 0;
+        }
+        else {
+            return "Unbekanntes Argument.";
+        }
+    }
+    if ((job->in[0] == '\0' && job->in_fd < 0) || job->out[0] == '\0' || job->factor == 0) {
+        return "in, out und f müssen angegeben werden.";
+    }
+    return NULL;
+}
+
+/**
+ * This function executes a job with the buffers of a worker.
+ * @param job Job
+ * @param bufs Buffers of the worker
+ * @param times Seconds for reading, interpolation and writing
+ * @return NULL on success, an error message otherwise
+ */
+static const char *run_job(const struct serve_job *job, struct serve_buffers *bufs, double *times) {
+    double t0 = now();
+    FILE *instream = (job->in_fd >= 0) ? fdopen(job->in_fd, "r") : fopen(job->in, "r");
+    if (instream == NULL) {
+        if (job->in_fd >= 0) {
+            close(job->in_fd);
+        }
+        return "Fehler beim Öffnen der Eingabedatei.";
+    }
+    struct pnm_header header;
+    if (pnm_read_header(instream, &header) != 0) {
+        fclose(instream);
+        return "Der Header der Eingabedatei ist ungültig.";
+    }
+    size_t width = header.width;
+    size_t height = header.height;
+    size_t channels = pnm_channels(&header);
+    size_t s = job->factor;
+    if (pnm_sample_bytes(&header) == 2) {
+        fclose(instream);
+        return "16 Bit Bilder werden vom Daemon nicht unterstützt.";
+    }
+    if (!kernel_supports(&kernels[job->impl], s)) {
+        fclose(instream);
+        return "Die Implementierung unterstützt diese CPU oder den Skalierungsfaktor nicht.";
+    }
+    if (width == 0 || height == 0 || s > SIZE_MAX / width || s > SIZE_MAX / height ||
+        height * s > SIZE_MAX / (width * s) || height > SIZE_MAX / 3 / width) {
+        fclose(instream);
+        return "Länge des Ausgabebildes generiert Overflow.";
+    }
+    if (reserve(&bufs->img, &bufs->img_cap, width * height * channels) != 0 ||
+        reserve(&bufs->tmp, &bufs->tmp_cap, width * height) != 0 ||
+        reserve(&bufs->result, &bufs->result_cap, width * s * height * s) != 0) {
+        fclose(instream);
+        return "Speicherallokation hat nicht funktioniert.";
+    }
+    struct pnm_reader reader;
+    if (pnm_reader_init(&reader, instream, &header) != 0) {
+        fclose(instream);
+        return "Speicherallokation hat nicht funktioniert.";
+    }
+    int err = pnm_read_rows(&reader, height, bufs->img);
+    pnm_reader_free(&reader);
+    fclose(instream);
+    if (err != 0) {
+        return (err == PNM_ERR_DATA) ? "Die Bilddaten der Eingabedatei sind ungültig."
+                                     : "Lesen von der Eingabedatei hat nicht funktioniert.";
+    }
+
+    double t1 = now();
+    const uint8_t *gray = bufs->img;
+    if (channels == 3) {
+        grayscale(bufs->img, bufs->tmp, width, height, job->coeffs[0], job->coeffs[1], job->coeffs[2]);
+        gray = bufs->tmp;
+    }
+    kernels[job->impl].gray(gray, width, height, s, bufs->result);
+
+    double t2 = now();
+    FILE *outstream = fopen(job->out, "wb");
+    if (outstream == NULL) {
+        return "Fehler beim erstellen der Ausgabedatei.";
+    }
+    char metadata[METADATA_MAX];
+    size_t metalen = create_metadata(metadata, job->ascii, 1, 255, width * s, height * s);
+    bool failed = fwrite(metadata, sizeof(char), metalen, outstream) != metalen;
+    struct pnm_cache outcache;
+    // The client usually reads the result of its job right away
+    pnm_cache_open(&outcache, outstream, false, false);
+    failed = failed || pnm_write_cached(&outcache, outstream, bufs->result, width * s, height * s, job->ascii) != 0;
+    if (fclose(outstream) != 0 || failed) {
+        return "Schreiben in die Ausgabedatei hat nicht funktioniert.";
+    }
+
+    double t3 = now();
+    times[0] = t1 - t0;
+    times[1] = t2 - t1;
+    times[2] = t3 - t2;
+    return NULL;
+}
+
+/**
+ * This function starts the read-ahead of the inputs of the queued jobs, i.e.
+ * the complete lines that have arrived behind the current job, so their
+ * reads overlap with the current job.
+ * @param line First queued line
+ * @param end End of the received bytes
+ * @return Start of the first line that is not complete yet
+ */
+static char *prefetch_queued(char *line, char *end) {
+    char *nl;
+    while ((nl = memchr(line, '\n', end - line)) != NULL) {
+        // parse_job modifies the line, a copy is parsed; in=fd jobs have no path
+        char copy[SERVE_LINE_MAX];
+        struct serve_job job;
+        memcpy(copy, line, nl - line);
+        copy[nl - line] = '\0';
+        if (parse_job(copy, &job, -1) == NULL) {
+            pnm_prefetch(job.in);
+        }
+        line = nl + 1;
+    }
+    return line;
+}
+
+/**
+ * This function answers the jobs of one connection until the client closes it.
+ * @param conn Connected socket
+ * @param bufs Buffers of the worker
+ */
+static void handle_connection(int conn, struct serve_buffers *bufs) {
+    char buf[SERVE_LINE_MAX];
+    size_t len = 0;
+    int fd = -1; // Descriptor that arrived with the last received bytes
+    size_t fd_end = 0; // Offset of the last byte in buf that arrived together with fd
+    size_t prefetched = 0; // Bytes of buf whose jobs have been prefetched
+    bool closed = false;
+
+    while (!closed) {
+        // Ancillary data (SCM_RIGHTS) is received together with the bytes of the line
+        union {
+            struct cmsghdr hdr;
+            char space[CMSG_SPACE(sizeof(int) * SERVE_FDS_MAX)];
+        } control;
+        struct iovec iov = { buf + len, sizeof(buf) - len };
+        struct msghdr msg = { 0 };
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+        ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+        if (n <= 0) {
+            break;
+        }
+        // Only the first descriptor is used, the others would leak
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++) {
+                int received;
+                memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (fd >= 0) {
+                    close(received);
+                    continue;
+                }
+                fd = received;
+                fd_end = len + (size_t)n - 1;
+            }
+        }
+        len += (size_t)n;
+
+        // Execute every complete line
+        char *line = buf;
+        char *nl;
+        while ((nl = memchr(line, '\n', buf + len - line)) != NULL) {
+            *nl = '\0';
+            char *queued = (buf + prefetched > nl + 1) ? buf + prefetched : nl + 1;
+            prefetched = prefetch_queued(queued, buf + len) - buf;
+            char reply[256];
+            struct serve_job job;
+            // The descriptor belongs to the line its bytes arrived with, not to the lines before it
+            bool owner = fd >= 0 && (size_t)(nl - buf) >= fd_end;
+            const char *error = parse_job(line, &job, owner ? fd : -1);
+            bool handed = error == NULL && job.in_fd >= 0;
+            if (error == NULL) {
+                double times[3];
+                double start = now();
+                error = run_job(&job, bufs, times);
+                if (error == NULL) {
+                    snprintf(reply, sizeof(reply), "ok read=%f interpolation=%f write=%f total=%f\n",
+                             times[0], times[1], times[2], now() - start);
+                }
+            }
+            // run_job closed the descriptor with its stream, otherwise (parse error, in=<path>) it is closed
+            // here, so a later in=fd line without a descriptor can not read the input of this one
+            if (owner) {
+                if (!handed) {
+                    close(fd);
+                }
+                fd = -1;
+            }
+            if (error != NULL) {
+                snprintf(reply, sizeof(reply), "error %s\n", error);
+            }
+            if (send(conn, reply, strlen(reply), MSG_NOSIGNAL) < 0) {
+                closed = true;
+                break;
+            }
+            line = nl + 1;
+        }
+        len -= (size_t)(line - buf);
+        fd_end = (fd_end > (size_t)(line - buf)) ? fd_end - (size_t)(line - buf) : 0;
+        prefetched = (prefetched > (size_t)(line - buf)) ? prefetched - (size_t)(line - buf) : 0;
+        memmove(buf, line, len);
+        if (len == sizeof(buf)) {
+            const char *reply = "error Die Zeile ist zu lang.\n";
+            send(conn, reply, strlen(reply), MSG_NOSIGNAL);
+            break;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    close(conn);
+}
+
+/**
+ * This function is the loop of a worker thread: it accepts connections and
+ * answers their jobs.
+ * @param arg Listening socket (int *)
+ */
+static void *worker_main(void *arg) {
+    int sock = *(int *)arg;
+    struct serve_buffers bufs = { 0 };
+    while (true) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn >= 0) {
+            handle_connection(conn, &bufs);
+        }
+    }
+    return NULL;
+}
+
+int serve(const char *path, size_t threads) {
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path) >= (int)sizeof(addr.sun_path)) {
+        return -1;
+    }
+    static int sock;
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, SERVE_BACKLOG) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    // All workers accept on the same socket, the calling thread is the first one
+    for (size_t w = 1; w < threads; w++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, &sock) != 0) {
+            close(sock);
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    fprintf(stdout, "Daemon wartet auf %s (%lu Threads)\n", path, threads);
+    fflush(stdout);
+    worker_main(&sock);
+    return -1;
+}
@@ -0,0 +1,24 @@
+#include <stddef.h>
+
+// Longest job descriptor (one line) the daemon accepts
+#define SERVE_LINE_MAX 4096
+// Pending connections of the listening socket
+#define SERVE_BACKLOG 128
+// Descriptors that are received with one message, only the first one is used
+#define SERVE_FDS_MAX 16
+
+/**
+ * This function runs the daemon: it listens on a Unix domain socket and
+ * executes the jobs of all connections on threads worker threads, which stay
+ * alive between jobs and keep their buffers. Every job is one line of
+ * key=value pairs, e.g.
+ *   in=bird.ppm out=bird.pgm f=3 coeffs=0.3,0.59,0.11 V=1
+ * in=fd reads the input from a file descriptor that was passed with the line
+ * (SCM_RIGHTS). Every job is answered with one line, either
+ *   ok read=<s> interpolation=<s> write=<s> total=<s>
+ * or error <message>.
+ * @param path Path of the socket, an existing file is replaced
+ * @param threads Number of worker threads
+ * @return -1 if the socket or the threads could not be set up, does not return otherwise
+ */
+int serve(const char *path, size_t threads);
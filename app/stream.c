@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "interpolate.h"
+#include "grayscale.h"
+#include "pnm.h"
+#include "pool.h"
+#include "stream.h"
+#include "trace.h"
+
+/**
+ * This function reads the next source row and stores it as grayscale row, or
+ * as it is for color output.
+ * @param reader Reader of the image data
+ * @param color Keep the RGB samples of a color image
+ * @param rgb Buffer for one row of a color image
+ * @param row Grayscale (or RGB) row
+ * @param a, @param b, @param c Coefficients for the grayscale conversion
+ * @return 0 on success, STREAM_ERR_READ or STREAM_ERR_DATA otherwise
+ */
+static int read_row(struct pnm_reader *reader, bool color, uint8_t *rgb, uint8_t *row, float a, float b, float c) {
+    // Grayscale inputs and color output don't need the conversion
+    bool convert = !color && pnm_channels(&reader->header) == 3;
+    int ret = pnm_read_rows(reader, 1, convert ? rgb : row);
+    if (ret != 0) {
+        return (ret == PNM_ERR_DATA) ? STREAM_ERR_DATA : STREAM_ERR_READ;
+    }
+    if (convert) {
+        grayscale(rgb, row, reader->header.width, 1, a, b, c);
+    }
+    return 0;
+}
+
+/**
+ * This function is interpolate_stream for 16 bit images (maxval above 255).
+ * The rows are read and written with 16 bit samples and converted to
+ * grayscale with grayscale16.
+ */
+static int interpolate_stream16(struct pnm_reader *reader, float a, float b, float c, const size_t *factors,
+                                size_t nfactors, FILE **outstreams, struct pnm_cache *caches, bool ascii) {
+    size_t width = reader->header.width;
+    size_t height = reader->header.height;
+    bool convert = pnm_channels(&reader->header) == 3;
+    int ret = 0;
+
+    // One RGB row, the grayscale rows i and i + 1 and one band per factor
+    uint16_t *rgb = malloc(width * 3 * sizeof(uint16_t));
+    uint16_t *gray = malloc(width * 2 * sizeof(uint16_t));
+    uint16_t **bands = calloc(nfactors, sizeof(uint16_t *));
+    if (rgb == NULL || gray == NULL || bands == NULL) {
+        ret = STREAM_ERR_MEMORY;
+    }
+    for (size_t k = 0; k < nfactors && ret == 0; k++) {
+        bands[k] = malloc(width * factors[k] * factors[k] * sizeof(uint16_t));
+        if (bands[k] == NULL) {
+            ret = STREAM_ERR_MEMORY;
+        }
+    }
+
+    for (size_t i = 0; i < height && ret == 0; i++) {
+        // Row 0 first, then always the row below the current quad row
+        for (size_t r = (i == 0) ? 0 : 1; r < 2 && i + r < height && ret == 0; r++) {
+            int err = pnm_read_rows16(reader, 1, convert ? rgb : gray + r * width);
+            if (err != 0) {
+                ret = (err == PNM_ERR_DATA) ? STREAM_ERR_DATA : STREAM_ERR_READ;
+            }
+            else if (convert) {
+                grayscale16(rgb, gray + r * width, width, 1, a, b, c);
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        for (size_t k = 0; k < nfactors; k++) {
+            size_t s = factors[k];
+            uint64_t t = trace_begin();
+            interpolate_region16(gray, i, width, height, s, 0, i * s, width * s, s, bands[k]);
+            trace_end("Band", (long)i, t);
+            t = trace_begin();
+            if (pnm_write_pixels16(outstreams[k], bands[k], width * s, s, ascii) != 0) {
+                ret = STREAM_ERR_WRITE;
+                break;
+            }
+            pnm_cache_written(&caches[k], outstreams[k]);
+            trace_end("Schreiben", (long)i, t);
+        }
+
+        // Row i + 1 becomes the upper row of the next quad row
+        memcpy(gray, gray + width, width * sizeof(uint16_t));
+    }
+
+    if (bands != NULL) {
+        for (size_t k = 0; k < nfactors; k++) {
+            free(bands[k]);
+        }
+    }
+    free(bands);
+    free(gray);
+    free(rgb);
+    return ret;
+}
+
+/**
+ * Band of source rows that the pool interpolates
+ * @param rows Source rows of the band (grayscale or RGB), starting with row first
+ * @param first Index of the first source row of the band
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param factors Scaling factors
+ * @param nfactors Number of scaling factors
+ * @param color Interpolate the three color planes
+ * @param fast Use the fast kernel
+ * @param planes Color planes of two source rows per worker
+ * @param bands One band of output rows per factor
+ */
+struct band_job {
+    const uint8_t *rows;
+    size_t first;
+    size_t width;
+    size_t height;
+    const size_t *factors;
+    size_t nfactors;
+    bool color;
+    bool fast;
+    uint8_t *planes;
+    uint8_t **bands;
+};
+
+/**
+ * This function interpolates the output rows of one source row of the band
+ * for all factors (pool task).
+ * @param ctx Job (struct band_job)
+ * @param task Source row relative to the first row of the band
+ * @param worker Index of the worker
+ */
+static void band_task(void *ctx, size_t task, size_t worker) {
+    const struct band_job *job = ctx;
+    size_t channels = job->color ? 3 : 1;
+    size_t rowlen = job->width * channels;
+    size_t i = job->first + task;
+    uint64_t t = trace_begin();
+    for (size_t k = 0; k < job->nfactors; k++) {
+        size_t s = job->factors[k];
+        uint8_t *band = job->bands[k] + task * rowlen * s * s;
+        if (job->color) {
+            interpolate_color(job->rows, job->first, job->width, job->height, s, 0, i * s, job->width * s, s,
+                              job->planes + worker * rowlen * 2, band);
+        }
+        else {
+            interpolate_rows(job->rows, job->first, job->width, job->height, &job->factors[k], 1, i, job->fast,
+                             &band);
+        }
+    }
+    trace_end("Band", (long)i, t);
+}
+
+int interpolate_stream(struct pnm_reader *reader, float a, float b, float c, const size_t *factors, size_t nfactors,
+                       FILE **outstreams, bool ascii, bool color, bool fast, size_t band_rows, struct pool *pool) {
+    size_t width = reader->header.width;
+    size_t height = reader->header.height;
+    size_t channels = color ? 3 : 1;
+    size_t rowlen = width * channels;
+    size_t workers = pool ? pool->nworkers : 1;
+    int ret = 0;
+
+    // The written blocks of the outputs leave the page cache
+    struct pnm_cache *caches = calloc(nfactors, sizeof(struct pnm_cache));
+    if (caches == NULL) {
+        return STREAM_ERR_MEMORY;
+    }
+    for (size_t k = 0; k < nfactors; k++) {
+        pnm_cache_open(&caches[k], outstreams[k], false, true);
+    }
+    if (pnm_sample_bytes(&reader->header) == 2) {
+        ret = interpolate_stream16(reader, a, b, c, factors, nfactors, outstreams, caches, ascii);
+        free(caches);
+        return ret;
+    }
+
+    // One RGB row, the source rows of a band and the first row of the next one, the planes and one band per factor
+    uint8_t *rgb = malloc(width * 3);
+    uint8_t *rows = malloc(rowlen * (band_rows + 1));
+    uint8_t *planes = color ? malloc(rowlen * 2 * workers) : NULL;
+    uint8_t **bands = calloc(nfactors, sizeof(uint8_t *));
+    if (rgb == NULL || rows == NULL || (color && planes == NULL) || bands == NULL) {
+        ret = STREAM_ERR_MEMORY;
+    }
+    for (size_t k = 0; k < nfactors && ret == 0; k++) {
+        bands[k] = malloc(rowlen * factors[k] * factors[k] * band_rows);
+        if (bands[k] == NULL) {
+            ret = STREAM_ERR_MEMORY;
+        }
+    }
+
+    // First source row
+    if (ret == 0 && height > 0) {
+        ret = read_row(reader, color, rgb, rows, a, b, c);
+    }
+
+    struct band_job job = {
+        .rows = rows, .width = width, .height = height, .factors = factors, .nfactors = nfactors,
+        .color = color, .fast = fast, .planes = planes, .bands = bands,
+    };
+    for (size_t i = 0; i < height && ret == 0; i += band_rows) {
+        // The rows of the last quad row of the band need the first row of the next band as well
+        size_t n = (height - i < band_rows) ? height - i : band_rows;
+        for (size_t r = 1; r <= n && i + r < height && ret == 0; r++) {
+            ret = read_row(reader, color, rgb, rows + r * rowlen, a, b, c);
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        job.first = i;
+        if (pool) {
+            pool_run(pool, n, band_task, &job);
+        }
+        else {
+            for (size_t r = 0; r < n; r++) {
+                band_task(&job, r, 0);
+            }
+        }
+        uint64_t t = trace_begin();
+        for (size_t k = 0; k < nfactors; k++) {
+            if (pnm_write_cached(&caches[k], outstreams[k], bands[k], rowlen * factors[k], n * factors[k], ascii) != 0) {
+                ret = STREAM_ERR_WRITE;
+                break;
+            }
+        }
+        trace_end("Schreiben", (long)i, t);
+
+        // The first row of the next band becomes the first row of the buffer
+        memcpy(rows, rows + n * rowlen, rowlen);
+    }
+
+    if (bands != NULL) {
+        for (size_t k = 0; k < nfactors; k++) {
+            free(bands[k]);
+        }
+    }
+    free(bands);
+    free(caches);
+    free(planes);
+    free(rows);
+    free(rgb);
+    return ret;
+}
@@ -0,0 +1,40 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct pnm_reader;
+struct pool;
+
+// Errors of interpolate_stream
+#define STREAM_ERR_MEMORY -1 // Buffers could not be allocated
+#define STREAM_ERR_READ -2   // Input ended before the last row
+#define STREAM_ERR_WRITE -3  // An output could not be written
+#define STREAM_ERR_DATA -4   // A sample of an ASCII input is invalid
+
+/**
+ * This function reads the image data row by row, converts every row to
+ * grayscale (grayscale inputs and color output take the rows as they are)
+ * and writes the interpolated rows for all scaling factors as soon as the
+ * source rows they depend on have arrived. The rows are processed in bands
+ * of band_rows source rows, only the rows of one band and one band of output
+ * rows per factor are kept in memory, so the input and the outputs may be
+ * pipes of any length. The source rows of a band are interpolated on the
+ * pool, the bands are read and written in order. 16 bit images (maxval above
+ * 255) are processed row by row with 16 bit samples and keep their maxval.
+ * @param reader Reader of the image data
+ * @param a First coefficient for the grayscale conversion (floating point)
+ * @param b Second coefficient for the grayscale conversion (floating point)
+ * @param c Third coefficient for the grayscale conversion (floating point)
+ * @param factors Scaling factors
+ * @param nfactors Number of scaling factors
+ * @param outstreams One output stream per factor, positioned after the header
+ * @param ascii Write the outputs as ASCII images (P2, P3)
+ * @param color Interpolate the three color planes of a color image (P6, P3 output, 8 bit only)
+ * @param fast Use the fast kernel interpolate_region_fast (8 bit grayscale only)
+ * @param band_rows Source rows per band (8 bit only, at least 1)
+ * @param pool Thread pool for the rows of a band, NULL for a single thread (8 bit only)
+ * @return 0 on success, one of the STREAM_ERR_* values otherwise
+ */
+int interpolate_stream(struct pnm_reader *reader, float a, float b, float c, const size_t *factors, size_t nfactors,
+                       FILE **outstreams, bool ascii, bool color, bool fast, size_t band_rows, struct pool *pool);
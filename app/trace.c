@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+/**
+ * Section of a thread
+ * @param name Name of the section
+ * @param index Number of the work unit, -1 for a stage
+ * @param start Start time in nanoseconds
+ * @param end End time in nanoseconds
+ */
+struct trace_event {
+    const char *name;
+    long index;
+    uint64_t start;
+    uint64_t end;
+};
+
+/**
+ * Buffer of one thread. Only its thread writes into it, full buffers stay in
+ * the list of all buffers and the thread continues in a new one.
+ * @param next Next buffer in the list of all buffers
+ * @param tid Thread id
+ * @param count Number of recorded events
+ * @param events Events
+ */
+struct trace_buffer {
+    struct trace_buffer *next;
+    long tid;
+    size_t count;
+    struct trace_event events[TRACE_CHUNK];
+};
+
+static bool enabled = false;
+static FILE *outstream = NULL;
+static uint64_t origin = 0; // Time of trace_start, the timestamps of the trace are relative to it
+static struct trace_buffer *buffers = NULL; // All buffers, pushed with compare and swap
+static size_t dropped = 0; // Events that got no buffer
+static _Thread_local struct trace_buffer *local = NULL; // Current buffer of the thread
+
+/**
+ * This function returns the monotonic time in nanoseconds.
+ */
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(1, &t); // 1 expands to CLOCK_MONOTONIC
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**
+ * This function writes all recorded events at the exit of the program.
+ */
+static void trace_finish(void) {
+    enabled = false;
+    fprintf(outstream, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (struct trace_buffer *buf = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); buf != NULL; buf = buf->next) {
+        for (size_t e = 0; e < buf->count; e++) {
+            const struct trace_event *ev = &buf->events[e];
+            fprintf(outstream, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,"
+                    "\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",\n", ev->name, ev->index < 0 ? "stage" : "unit",
+                    (int)getpid(), buf->tid, (ev->start - origin) / 1e3, (ev->end - ev->start) / 1e3);
+            if (ev->index >= 0) {
+                fprintf(outstream, ",\"args\":{\"index\":%ld}", ev->index);
+            }
+            fprintf(outstream, "}");
+            first = false;
+        }
+    }
+    fprintf(outstream, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%lu}}\n",
+            __atomic_load_n(&dropped, __ATOMIC_RELAXED));
+    if (fclose(outstream) != 0) {
+        fprintf(stderr, "Error: Schreiben der Trace-Datei hat nicht funktioniert.\n");
+    }
+}
+
+int trace_start(const char *path) {
+    outstream = fopen(path, "w");
+    if (outstream == NULL) {
+        return -1;
+    }
+    origin = now();
+    enabled = true;
+    atexit(trace_finish);
+    return 0;
+}
+
+uint64_t trace_begin(void) {
+    if (!enabled) {
+        return 0;
+    }
+    return now();
+}
+
+void trace_end(const char *name, long index, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t end = now();
+    if (local == NULL || local->count == TRACE_CHUNK) {
+        struct trace_buffer *buf = malloc(sizeof(struct trace_buffer));
+        if (buf == NULL) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        buf->tid = syscall(SYS_gettid);
+        buf->count = 0;
+        buf->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&buffers, &buf->next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        local = buf;
+    }
+    local->events[local->count] = (struct trace_event){ name, index, start, end };
+    local->count++;
+}
@@ -0,0 +1,30 @@
+#include <stdint.h>
+
+// Number of events in one buffer of the trace, every thread fills its own buffers
+#define TRACE_CHUNK 4096
+
+/**
+ * This function switches the trace on. From now on trace_begin and trace_end
+ * record the stages and work units of every thread, and at the exit of the
+ * program the events are written to path in the Chrome trace_event format
+ * (chrome://tracing, Perfetto).
+ * @param path Output file of the trace
+ * @return 0 on success, -1 if the file could not be created
+ */
+int trace_start(const char *path);
+
+/**
+ * This function returns the start time of a traced section. While the trace
+ * is switched off, it only reads a flag and returns 0.
+ * @return Start time in nanoseconds, 0 if the trace is off
+ */
+uint64_t trace_begin(void);
+
+/**
+ * This function records a section of the calling thread, which started at
+ * start. The event is appended to a buffer of the thread without any lock.
+ * @param name Name of the section (a string literal, it is only stored as pointer)
+ * @param index Number of the work unit (band, tile), -1 for a stage
+ * @param start Return value of trace_begin, nothing is recorded for 0
+ */
+void trace_end(const char *name, long index, uint64_t start);
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "interpolate.h"
+#include "kernel.h"
+#include "pnm.h"
+#include "pool.h"
+#include "stream.h"
+#include "tune.h"
+
+// Output rows per task of the thread benchmark
+#define TUNE_STRIP 32
+
+// Scaling factors and widths of the benchmark images
+static const size_t tune_factors[] = { 2, 3, 4, 8, 16, 32 };
+static const size_t tune_widths[] = { 256, 1024, 4096 };
+// Band heights per thread that are tried for streaming
+static const size_t tune_bands[] = { 1, 2, 4, 8, 16 };
+
+/**
+ * Benchmark image
+ * @param gray Grayscale source image
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param scale_factor Scaling factor
+ * @param result Output image
+ * @param impl Implementation version (kernel benchmark)
+ * @param pool Thread pool (thread and band benchmark)
+ * @param pnm Binary P5 image with header (band benchmark)
+ * @param pnm_len Length of pnm
+ * @param band_rows Source rows per band (band benchmark)
+ * @param null Output stream of the band benchmark (/dev/null)
+ * @param failed A run of the band benchmark failed
+ */
+struct tune_bench {
+    const uint8_t *gray;
+    size_t width;
+    size_t height;
+    size_t scale_factor;
+    uint8_t *result;
+    size_t impl;
+    struct pool *pool;
+    uint8_t *pnm;
+    size_t pnm_len;
+    size_t band_rows;
+    FILE *null;
+    bool failed;
+};
+
+/**
+ * This function returns the monotonic time in seconds.
+ */
+static double now(void) {
+    struct timespec t;
+    clock_gettime(1, &t); // 1 expands to CLOCK_MONOTONIC
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * This function reads the name of the CPU from /proc/cpuinfo.
+ * @param name Buffer for the name
+ * @param len Length of the buffer
+ */
+static void cpu_name(char *name, size_t len) {
+    snprintf(name, len, "unbekannt");
+    FILE *info = fopen("/proc/cpuinfo", "r");
+    if (info == NULL) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), info) != NULL) {
+        char *value = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && value != NULL) {
+            value += strspn(value + 1, " \t") + 1;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(name, len, "%s", value);
+            break;
+        }
+    }
+    fclose(info);
+}
+
+/**
+ * This function fills a buffer with pseudo-random bytes (xorshift64), so the
+ * data-dependent implementations see no regular pattern.
+ * @param buf Buffer
+ * @param len Length of the buffer
+ */
+static void fill_random(uint8_t *buf, size_t len) {
+    uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)(x >> 32);
+    }
+}
+
+/**
+ * This function runs one implementation on the benchmark image.
+ * @param bench Benchmark
+ */
+static void run_kernel(struct tune_bench *bench) {
+    kernels[bench->impl].gray(bench->gray, bench->width, bench->height, bench->scale_factor, bench->result);
+}
+
+/**
+ * This function interpolates a strip of TUNE_STRIP output rows (pool task).
+ * @param ctx Benchmark (struct tune_bench)
+ * @param task Index of the strip
+ * @param worker Index of the worker
+ */
+static void strip_task(void *ctx, size_t task, size_t worker) {
+    (void)worker;
+    const struct tune_bench *bench = ctx;
+    size_t out_width = bench->width * bench->scale_factor;
+    size_t out_height = bench->height * bench->scale_factor;
+    size_t y = task * TUNE_STRIP;
+    size_t h = (out_height - y < TUNE_STRIP) ? out_height - y : TUNE_STRIP;
+    interpolate_region(bench->gray, 0, bench->width, bench->height, bench->scale_factor, 0, y, out_width, h,
+                       bench->result + y * out_width);
+}
+
+/**
+ * This function interpolates the benchmark image in strips on the pool.
+ * @param bench Benchmark
+ */
+static void run_threads(struct tune_bench *bench) {
+    size_t out_height = bench->height * bench->scale_factor;
+    pool_run(bench->pool, (out_height + TUNE_STRIP - 1) / TUNE_STRIP, strip_task, bench);
+}
+
+/**
+ * This function streams the benchmark image from memory to /dev/null.
+ * @param bench Benchmark
+ */
+static void run_stream(struct tune_bench *bench) {
+    FILE *in = fmemopen(bench->pnm, bench->pnm_len, "r");
+    struct pnm_header header;
+    struct pnm_reader reader;
+    if (in == NULL || pnm_read_header(in, &header) != 0 || pnm_reader_init(&reader, in, &header) != 0) {
+        bench->failed = true;
+    }
+    else {
+        if (interpolate_stream(&reader, 0, 0, 0, &bench->scale_factor, 1, &bench->null, false, false, false,
+                               bench->band_rows, bench->pool) != 0) {
+            bench->failed = true;
+        }
+        pnm_reader_free(&reader);
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+}
+
+/**
+ * This function measures a candidate: the fastest of TUNE_REPEAT runs, or
+ * only the first run if it is more than TUNE_SLOWER times slower than the
+ * best candidate so far.
+ * @param run Function that runs the candidate once
+ * @param bench Benchmark
+ * @param best Time of the best candidate so far
+ * @return Time in seconds
+ */
+static double measure(void (*run)(struct tune_bench *), struct tune_bench *bench, double best) {
+    double fastest = 0;
+    for (size_t r = 0; r < TUNE_REPEAT; r++) {
+        double start = now();
+        run(bench);
+        double t = now() - start;
+        fastest = (r == 0 || t < fastest) ? t : fastest;
+        if (r == 0 && t > best * TUNE_SLOWER) {
+            break;
+        }
+    }
+    return fastest;
+}
+
+/**
+ * This function chooses the height of a benchmark image, so its output has
+ * about TUNE_PIXELS pixels.
+ * @param width Width of the source image
+ * @param s Scaling factor
+ */
+static size_t bench_height(size_t width, size_t s) {
+    size_t height = TUNE_PIXELS / (width * s * s);
+    return (height > 2) ? height : 2;
+}
+
+int tune_default_path(char *path, size_t len) {
+    const char *home = getenv("HOME");
+    if (home == NULL || home[0] == '\0') {
+        return -1;
+    }
+    return (snprintf(path, len, "%s/%s", home, TUNE_PROFILE) < (int)len) ? 0 : -1;
+}
+
+int tune_run(const char *path, size_t max_threads, FILE *report) {
+    struct tune_profile profile;
+    memset(&profile, 0, sizeof(profile));
+    cpu_name(profile.cpu, sizeof(profile.cpu));
+    fprintf(report, "CPU: %s\n", profile.cpu);
+
+    // 1. Implementations per scaling factor and width
+    fprintf(report, "Implementierungen (Millisekunden je Bild mit etwa %lu Ausgabepixeln):\n", TUNE_PIXELS);
+    for (size_t i = 0; i < sizeof(tune_factors) / sizeof(tune_factors[0]); i++) {
+        for (size_t j = 0; j < sizeof(tune_widths) / sizeof(tune_widths[0]); j++) {
+            struct tune_bench bench = { .width = tune_widths[j], .scale_factor = tune_factors[i] };
+            bench.height = bench_height(bench.width, bench.scale_factor);
+            size_t s = bench.scale_factor;
+            uint8_t *gray = malloc(bench.width * bench.height);
+            bench.result = malloc(bench.width * s * bench.height * s);
+            if (gray == NULL || bench.result == NULL) {
+                free(gray);
+                free(bench.result);
+                return TUNE_ERR_MEMORY;
+            }
+            fill_random(gray, bench.width * bench.height);
+            bench.gray = gray;
+
+            double best = 0;
+            size_t winner = 0;
+            fprintf(report, "  f=%-2lu w=%-4lu", s, bench.width);
+            // Only kernels with the output of V0 may be picked for -V auto, the reference always runs
+            for (size_t v = 0; v < nkernels; v++) {
+                if (kernels[v].precision != KERNEL_EXACT || !kernel_supports(&kernels[v], s)) {
+                    continue;
+                }
+                bench.impl = v;
+                double t = measure(run_kernel, &bench, v == 0 ? INFINITY : best);
+                fprintf(report, "  V%lu %8.2f", v, t * 1e3);
+                if (v == 0 || t < best) {
+                    best = t;
+                    winner = v;
+                }
+            }
+            fprintf(report, "  -> V%lu\n", winner);
+            profile.entries[profile.nentries++] = (struct tune_entry){ s, bench.width, winner };
+            free(gray);
+            free(bench.result);
+        }
+    }
+
+    // 2. Threads for the tiles, 3. band height for streaming, on a medium image
+    struct tune_bench bench = { .width = 1024, .scale_factor = 4 };
+    bench.height = bench_height(bench.width, bench.scale_factor);
+    size_t s = bench.scale_factor;
+    size_t header_len = METADATA_MAX;
+    uint8_t *gray = malloc(bench.width * bench.height);
+    bench.result = malloc(bench.width * s * bench.height * s);
+    bench.pnm = malloc(header_len + bench.width * bench.height);
+    bench.null = fopen("/dev/null", "wb");
+    int ret = (gray == NULL || bench.result == NULL || bench.pnm == NULL) ? TUNE_ERR_MEMORY
+            : (bench.null == NULL) ? TUNE_ERR_OPEN : 0;
+    if (ret == 0) {
+        fill_random(gray, bench.width * bench.height);
+        bench.gray = gray;
+        header_len = (size_t)snprintf((char *)bench.pnm, header_len, "P5\n%lu %lu\n255\n", bench.width, bench.height);
+        memcpy(bench.pnm + header_len, gray, bench.width * bench.height);
+        bench.pnm_len = header_len + bench.width * bench.height;
+    }
+
+    double best = 0;
+    profile.threads = 1;
+    fprintf(report, "Threads (f=%lu w=%lu):", s, bench.width);
+    for (size_t n = 1; n <= max_threads && ret == 0; n = (n < max_threads && n * 2 > max_threads) ? max_threads : n * 2) {
+        struct pool pool;
+        if (pool_create(&pool, n) != 0) {
+            ret = TUNE_ERR_MEMORY;
+            break;
+        }
+        bench.pool = &pool;
+        double t = measure(run_threads, &bench, n == 1 ? INFINITY : best);
+        pool_destroy(&pool);
+        fprintf(report, "  %lu: %.2f", n, t * 1e3);
+        if (n == 1 || t < best) {
+            best = t;
+            profile.threads = n;
+        }
+        if (n == max_threads) {
+            break;
+        }
+    }
+    fprintf(report, "  -> %lu\n", profile.threads);
+
+    profile.band = 1;
+    fprintf(report, "Bandhöhe beim Streaming (Quellzeilen je Thread):");
+    struct pool pool;
+    if (ret == 0 && profile.threads > 1 && pool_create(&pool, profile.threads) != 0) {
+        ret = TUNE_ERR_MEMORY;
+    }
+    bench.pool = (profile.threads > 1) ? &pool : NULL;
+    for (size_t i = 0; i < sizeof(tune_bands) / sizeof(tune_bands[0]) && ret == 0; i++) {
+        bench.band_rows = tune_bands[i] * profile.threads;
+        double t = measure(run_stream, &bench, i == 0 ? INFINITY : best);
+        fprintf(report, "  %lu: %.2f", tune_bands[i], t * 1e3);
+        if (i == 0 || t < best) {
+            best = t;
+            profile.band = tune_bands[i];
+        }
+    }
+    fprintf(report, "  -> %lu\n", profile.band);
+    if (ret == 0 && profile.threads > 1) {
+        pool_destroy(&pool);
+    }
+    ret = (ret == 0 && bench.failed) ? TUNE_ERR_MEMORY : ret;
+    free(gray);
+    free(bench.result);
+    free(bench.pnm);
+    if (bench.null != NULL) {
+        fclose(bench.null);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return TUNE_ERR_OPEN;
+    }
+    fprintf(out, "# Profil von --tune, wird von -V auto nur auf dieser CPU verwendet\n");
+    fprintf(out, "cpu=%s\n", profile.cpu);
+    fprintf(out, "threads=%lu\n", profile.threads);
+    fprintf(out, "band=%lu\n", profile.band);
+    for (size_t k = 0; k < profile.nentries; k++) {
+        fprintf(out, "f=%lu w=%lu V=%lu\n", profile.entries[k].factor, profile.entries[k].width,
+                profile.entries[k].impl);
+    }
+    return (fclose(out) == 0) ? 0 : TUNE_ERR_OPEN;
+}
+
+int tune_load(const char *path, struct tune_profile *profile) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return TUNE_ERR_OPEN;
+    }
+    memset(profile, 0, sizeof(*profile));
+    profile->threads = 1;
+    profile->band = 1;
+    char line[256];
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        struct tune_entry entry;
+        int end = -1;
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        if (strncmp(line, "cpu=", 4) == 0) {
+            snprintf(profile->cpu, sizeof(profile->cpu), "%s", line + 4);
+        }
+        else if (sscanf(line, "threads=%lu%n", &profile->threads, &end) == 1 && line[end] == '\0') {
+            ret = (profile->threads == 0 || profile->threads > POOL_MAX_WORKERS) ? TUNE_ERR_FORMAT : 0;
+        }
+        else if (sscanf(line, "band=%lu%n", &profile->band, &end) == 1 && line[end] == '\0') {
+            ret = (profile->band == 0) ? TUNE_ERR_FORMAT : 0;
+        }
+        else if (sscanf(line, "f=%lu w=%lu V=%lu%n", &entry.factor, &entry.width, &entry.impl, &end) == 3 &&
+                 line[end] == '\0' && entry.impl < nkernels && profile->nentries < TUNE_MAX) {
+            profile->entries[profile->nentries++] = entry;
+        }
+        else {
+            ret = TUNE_ERR_FORMAT;
+        }
+    }
+    fclose(in);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // A profile copied from another machine says nothing about this one
+    char cpu[TUNE_CPU_MAX];
+    cpu_name(cpu, sizeof(cpu));
+    return (strcmp(cpu, profile->cpu) == 0) ? 0 : TUNE_ERR_CPU;
+}
+
+size_t tune_impl(const struct tune_profile *profile, size_t factor, size_t width) {
+    // Largest factor not above the one of the image, otherwise the smallest
+    const struct tune_entry *best = NULL;
+    for (size_t k = 0; k < profile->nentries; k++) {
+        const struct tune_entry *e = &profile->entries[k];
+        bool fits = e->factor <= factor;
+        bool best_fits = best != NULL && best->factor <= factor;
+        if (best == NULL || (fits && (!best_fits || e->factor > best->factor)) ||
+            (!fits && !best_fits && e->factor < best->factor)) {
+            best = e;
+        }
+    }
+    if (best == NULL) {
+        return 0;
+    }
+    // The same for the width among the entries of that factor
+    size_t f = best->factor;
+    best = NULL;
+    for (size_t k = 0; k < profile->nentries; k++) {
+        const struct tune_entry *e = &profile->entries[k];
+        if (e->factor != f) {
+            continue;
+        }
+        bool fits = e->width <= width;
+        bool best_fits = best != NULL && best->width <= width;
+        if (best == NULL || (fits && (!best_fits || e->width > best->width)) ||
+            (!fits && !best_fits && e->width < best->width)) {
+            best = e;
+        }
+    }
+    return best->impl;
+}
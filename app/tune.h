@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include <stdio.h>
+
+// Name of the profile in the home directory, used if --profile is not given
+#define TUNE_PROFILE ".interpolate_tune"
+// Maximum number of entries of a profile
+#define TUNE_MAX 64
+// Longest CPU name stored in a profile
+#define TUNE_CPU_MAX 256
+// Output pixels of one benchmark image
+#define TUNE_PIXELS (4ul << 20)
+// Runs per candidate, the fastest one counts
+#define TUNE_REPEAT 3
+// A candidate whose first run is this many times slower than the best one is not repeated
+#define TUNE_SLOWER 4
+
+// Errors of tune_run and tune_load
+#define TUNE_ERR_OPEN -1   // The profile could not be opened or written
+#define TUNE_ERR_FORMAT -2 // The profile contains an invalid line
+#define TUNE_ERR_CPU -3    // The profile was measured on another CPU
+#define TUNE_ERR_MEMORY -4 // The benchmark buffers could not be allocated
+
+/**
+ * Fastest implementation for images of at least this scaling factor and width
+ * @param factor Scaling factor
+ * @param width Width of the source image
+ * @param impl Implementation version (-V)
+ */
+struct tune_entry {
+    size_t factor;
+    size_t width;
+    size_t impl;
+};
+
+/**
+ * Profile of a machine, written by tune_run
+ * @param cpu Name of the CPU the profile was measured on
+ * @param entries Fastest implementation per scaling factor and width
+ * @param nentries Number of entries
+ * @param threads Fastest number of threads for the tiles
+ * @param band Fastest band height for streaming, in source rows per thread
+ */
+struct tune_profile {
+    char cpu[TUNE_CPU_MAX];
+    struct tune_entry entries[TUNE_MAX];
+    size_t nentries;
+    size_t threads;
+    size_t band;
+};
+
+/**
+ * This function writes the path of the default profile, TUNE_PROFILE in the
+ * home directory.
+ * @param path Buffer for the path
+ * @param len Length of the buffer
+ * @return 0 on success, -1 if there is no home directory or the path is too long
+ */
+int tune_default_path(char *path, size_t len);
+
+/**
+ * This function benchmarks the implementations on random images of several
+ * scaling factors and widths, then the number of threads for the tiles and
+ * the band height for streaming, and writes the fastest configuration to a
+ * profile. Every candidate runs TUNE_REPEAT times, candidates that are far
+ * behind after their first run are dropped. The measurements are printed to
+ * report.
+ * @param path Path of the profile, an existing file is replaced
+ * @param max_threads Largest number of threads that is tried
+ * @param report Output of the measurements
+ * @return 0 on success, one of the TUNE_ERR_* values otherwise
+ */
+int tune_run(const char *path, size_t max_threads, FILE *report);
+
+/**
+ * This function reads a profile. A profile of another CPU is rejected.
+ * @param path Path of the profile
+ * @param profile Profile
+ * @return 0 on success, one of the TUNE_ERR_* values otherwise
+ */
+int tune_load(const char *path, struct tune_profile *profile);
+
+/**
+ * This function looks up the implementation for an image: the entry with the
+ * largest factor and then the largest width that are not above the ones of
+ * the image (the smallest ones if all are above).
+ * @param profile Profile
+ * @param factor Scaling factor
+ * @param width Width of the source image
+ * @return Implementation version, 0 if the profile has no entries
+ */
+size_t tune_impl(const struct tune_profile *profile, size_t factor, size_t width);
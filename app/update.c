@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "interpolate.h"
+#include "grayscale.h"
+#include "pnm.h"
+#include "update.h"
+
+int update_load(const char *path, size_t width, size_t height, const float *coeffs, uint8_t **gray) {
+    FILE *stream = fopen(path, "r");
+    if (stream == NULL) {
+        return UPDATE_ERR_OPEN;
+    }
+    struct pnm_header header;
+    if (pnm_read_header(stream, &header) != 0 || header.width != width || header.height != height ||
+        pnm_sample_bytes(&header) != 1) {
+        fclose(stream);
+        return UPDATE_ERR_HEADER;
+    }
+    size_t channels = pnm_channels(&header);
+    uint8_t *img = malloc(width * height * channels);
+    struct pnm_reader reader;
+    if (img == NULL || pnm_reader_init(&reader, stream, &header) != 0) {
+        free(img);
+        fclose(stream);
+        return UPDATE_ERR_MEMORY;
+    }
+    int err = pnm_read_rows(&reader, height, img);
+    pnm_reader_free(&reader);
+    fclose(stream);
+    if (err != 0) {
+        free(img);
+        return UPDATE_ERR_READ;
+    }
+    if (channels == 3) {
+        uint8_t *converted = malloc(width * height);
+        if (converted == NULL) {
+            free(img);
+            return UPDATE_ERR_MEMORY;
+        }
+        grayscale(img, converted, width, height, coeffs[0], coeffs[1], coeffs[2]);
+        free(img);
+        img = converted;
+    }
+    *gray = img;
+    return 0;
+}
+
+/**
+ * This function checks whether a source block differs between two images.
+ * @param a, @param b Images
+ * @param width Width of the images
+ * @param x, @param y, @param w, @param h Block
+ */
+static bool block_differs(const uint8_t *a, const uint8_t *b, size_t width, size_t x, size_t y, size_t w, size_t h) {
+    for (size_t row = y; row < y + h; row++) {
+        if (memcmp(a + row * width + x, b + row * width + x, w) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int update(const char *path, const uint8_t *gray, const uint8_t *old, size_t width, size_t height,
+           size_t scale_factor, const size_t *rects, size_t nrects, struct update_stats *stats) {
+    size_t s = scale_factor;
+    size_t out_width = width * s;
+    size_t out_height = height * s;
+
+    // The existing output has to match the new source, its header length is kept
+    FILE *stream = fopen(path, "r+b");
+    if (stream == NULL) {
+        return UPDATE_ERR_OPEN;
+    }
+    struct pnm_header header;
+    if (pnm_read_header(stream, &header) != 0 || header.magic != '5' || header.width != out_width ||
+        header.height != out_height || header.maxval != 255) {
+        fclose(stream);
+        return UPDATE_ERR_HEADER;
+    }
+    off_t metalen = ftello(stream);
+    int fd = fileno(stream);
+
+    // Mark the dirty blocks
+    size_t bw = (width + UPDATE_BLOCK - 1) / UPDATE_BLOCK;
+    size_t bh = (height + UPDATE_BLOCK - 1) / UPDATE_BLOCK;
+    bool *dirty = calloc(bw * bh, sizeof(bool));
+    uint8_t *row = malloc(out_width);
+    if (dirty == NULL || row == NULL) {
+        free(dirty);
+        free(row);
+        fclose(stream);
+        return UPDATE_ERR_MEMORY;
+    }
+    if (old != NULL) {
+        for (size_t by = 0; by < bh; by++) {
+            for (size_t bx = 0; bx < bw; bx++) {
+                size_t x = bx * UPDATE_BLOCK;
+                size_t y = by * UPDATE_BLOCK;
+                size_t w = (width - x < UPDATE_BLOCK) ? width - x : UPDATE_BLOCK;
+                size_t h = (height - y < UPDATE_BLOCK) ? height - y : UPDATE_BLOCK;
+                dirty[by * bw + bx] = block_differs(gray, old, width, x, y, w, h);
+            }
+        }
+    }
+    for (size_t r = 0; r < nrects; r++) {
+        const size_t *rect = rects + 4 * r;
+        if (rect[0] >= width || rect[1] >= height) {
+            continue;
+        }
+        size_t x1 = (rect[2] > width - rect[0]) ? width : rect[0] + rect[2];
+        size_t y1 = (rect[3] > height - rect[1]) ? height : rect[1] + rect[3];
+        for (size_t by = rect[1] / UPDATE_BLOCK; by <= (y1 - 1) / UPDATE_BLOCK; by++) {
+            for (size_t bx = rect[0] / UPDATE_BLOCK; bx <= (x1 - 1) / UPDATE_BLOCK; bx++) {
+                dirty[by * bw + bx] = true;
+            }
+        }
+    }
+
+    // Recompute every run of dirty blocks in a block row
+    stats->blocks = bw * bh;
+    stats->dirty = 0;
+    stats->pixels = 0;
+    int ret = 0;
+    for (size_t by = 0; by < bh && ret == 0; by++) {
+        for (size_t bx = 0; bx < bw && ret == 0; bx++) {
+            if (!dirty[by * bw + bx]) {
+                continue;
+            }
+            size_t run = bx;
+            while (run < bw && dirty[by * bw + run]) {
+                run++;
+            }
+            stats->dirty += run - bx;
+
+            // Changed source pixels x0 .. x1 - 1, y0 .. y1 - 1
+            size_t x0 = bx * UPDATE_BLOCK;
+            size_t y0 = by * UPDATE_BLOCK;
+            size_t x1 = (run * UPDATE_BLOCK < width) ? run * UPDATE_BLOCK : width;
+            size_t y1 = ((by + 1) * UPDATE_BLOCK < height) ? (by + 1) * UPDATE_BLOCK : height;
+            // Quads that read them: one quad row above, one quad column left and right
+            size_t qx0 = (x0 > 0) ? x0 - 1 : 0;
+            size_t qy0 = (y0 > 0) ? y0 - 1 : 0;
+            size_t qx1 = (x1 + 1 < width) ? x1 + 1 : width;
+            size_t X = qx0 * s;
+            size_t Y = qy0 * s;
+            size_t W = (qx1 - qx0) * s;
+            size_t H = (y1 - qy0) * s;
+
+            for (size_t r = 0; r < H; r++) {
+                interpolate_region(gray, 0, width, height, s, X, Y + r, W, 1, row);
+                if (pwrite(fd, row, W, metalen + (off_t)((Y + r) * out_width + X)) != (ssize_t)W) {
+                    ret = UPDATE_ERR_WRITE;
+                    break;
+                }
+            }
+            stats->pixels += W * H;
+            bx = run;
+        }
+    }
+
+    free(dirty);
+    free(row);
+    if (fclose(stream) != 0 && ret == 0) {
+        ret = UPDATE_ERR_WRITE;
+    }
+    return ret;
+}
@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include <stdint.h>
+
+// Edge length of the source blocks that are compared and marked dirty
+#define UPDATE_BLOCK 32
+// Most dirty rectangles that can be passed with --dirty
+#define UPDATE_MAX_RECTS 64
+
+// Errors of update_load and update
+#define UPDATE_ERR_OPEN -1     // File could not be opened
+#define UPDATE_ERR_HEADER -2   // Header invalid or dimensions don't match
+#define UPDATE_ERR_READ -3     // Image data could not be read
+#define UPDATE_ERR_MEMORY -4   // Buffer could not be allocated
+#define UPDATE_ERR_WRITE -5    // Output could not be written
+
+/**
+ * Counters of an update
+ * @param blocks Number of source blocks
+ * @param dirty Number of dirty source blocks
+ * @param pixels Number of output pixels that were recomputed
+ */
+struct update_stats {
+    size_t blocks;
+    size_t dirty;
+    size_t pixels;
+};
+
+/**
+ * This function reads an 8 bit image of the given size and converts it to
+ * grayscale, e.g. the previous version of the input.
+ * @param path Path of the image
+ * @param width Expected width
+ * @param height Expected height
+ * @param coeffs Coefficients for the grayscale conversion
+ * @param gray Grayscale image (allocated, freed by the caller)
+ * @return 0 on success, one of the UPDATE_ERR_* values otherwise
+ */
+int update_load(const char *path, size_t width, size_t height, const float *coeffs, uint8_t **gray);
+
+/**
+ * This function patches an existing binary grayscale output (P5) after the
+ * source image has changed. The source is split into UPDATE_BLOCK x
+ * UPDATE_BLOCK blocks; a block is dirty if one of its pixels differs from
+ * old, or if it overlaps one of the dirty rectangles. Every output pixel only
+ * depends on the source pixels of its quad and of the quad to its left (edge
+ * rule of the last row), so for a dirty block only the output of the quads
+ * one row above, one column left and one column right of it is recomputed and
+ * written into the file at its position.
+ * @param path Output file written for the previous source
+ * @param gray Grayscale source image
+ * @param old Previous grayscale source image, NULL if only rects are given
+ * @param width Width of the source image
+ * @param height Height of the source image
+ * @param scale_factor Scaling factor of the output
+ * @param rects Dirty rectangles in source coordinates (x, y, w, h each)
+ * @param nrects Number of dirty rectangles
+ * @param stats Counters of the update
+ * @return 0 on success, one of the UPDATE_ERR_* values otherwise
+ */
+int update(const char *path, const uint8_t *gray, const uint8_t *old, size_t width, size_t height,
+           size_t scale_factor, const size_t *rects, size_t nrects, struct update_stats *stats);